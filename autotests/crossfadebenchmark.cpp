@@ -0,0 +1,139 @@
+/*
+    This file belong to the KMPlayer project, a movie player plugin for Konqueror
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include <QtTest>
+#include <QElapsedTimer>
+
+#include <cairo.h>
+
+/**
+ * Throughput of a RealPix crossfade frame in megapixels per second, on
+ * image surfaces like the MIT-SHM backing store, so pixman does the blend.
+ * Compares painting the image through a scaling pattern every frame, as
+ * before, to the unscaled blend of the copy paintEffectImage scales once.
+ */
+class CrossfadeBenchmark : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void initTestCase ();
+    void cleanupTestCase ();
+    void crossfade_data ();
+    void crossfade ();
+private:
+    void scaledPattern (double alpha);
+    void preScaled (double alpha);
+
+    cairo_surface_t *image = nullptr;   // the decoded RealPix image
+    cairo_surface_t *scaled = nullptr;  // its copy at device size
+    cairo_surface_t *target = nullptr;
+};
+
+static const int image_width = 640;
+static const int image_height = 360;
+static const int width = 1280;
+static const int height = 720;
+
+void CrossfadeBenchmark::initTestCase () {
+    image = cairo_image_surface_create (CAIRO_FORMAT_RGB24,
+            image_width, image_height);
+    cairo_t *cr = cairo_create (image);
+    cairo_pattern_t *gradient = cairo_pattern_create_linear (0, 0,
+            image_width, image_height);
+    cairo_pattern_add_color_stop_rgb (gradient, 0, 0.9, 0.2, 0.1);
+    cairo_pattern_add_color_stop_rgb (gradient, 1, 0.1, 0.3, 0.8);
+    cairo_set_source (cr, gradient);
+    cairo_paint (cr);
+    cairo_pattern_destroy (gradient);
+    cairo_destroy (cr);
+
+    // scaledImage
+    scaled = cairo_surface_create_similar (image, CAIRO_CONTENT_COLOR,
+            width, height);
+    cairo_matrix_t mat;
+    cairo_matrix_init_scale (&mat,
+            1.0 * image_width / width, 1.0 * image_height / height);
+    cairo_pattern_t *pat = cairo_pattern_create_for_surface (image);
+    cairo_pattern_set_extend (pat, CAIRO_EXTEND_NONE);
+    cairo_pattern_set_matrix (pat, &mat);
+    cr = cairo_create (scaled);
+    cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
+    cairo_set_source (cr, pat);
+    cairo_paint (cr);
+    cairo_destroy (cr);
+    cairo_pattern_destroy (pat);
+
+    target = cairo_image_surface_create (CAIRO_FORMAT_RGB24, width, height);
+    QCOMPARE (cairo_surface_status (scaled), CAIRO_STATUS_SUCCESS);
+    QCOMPARE (cairo_surface_status (target), CAIRO_STATUS_SUCCESS);
+}
+
+void CrossfadeBenchmark::cleanupTestCase () {
+    cairo_surface_destroy (target);
+    cairo_surface_destroy (scaled);
+    cairo_surface_destroy (image);
+}
+
+void CrossfadeBenchmark::scaledPattern (double alpha) {
+    cairo_t *cr = cairo_create (target);
+    cairo_matrix_t matrix;
+    cairo_matrix_init_scale (&matrix,
+            1.0 * image_width / width, 1.0 * image_height / height);
+    cairo_rectangle (cr, 0, 0, width, height);
+    cairo_pattern_t *pat = cairo_pattern_create_for_surface (image);
+    cairo_pattern_set_extend (pat, CAIRO_EXTEND_NONE);
+    cairo_pattern_set_matrix (pat, &matrix);
+    cairo_set_source (cr, pat);
+    cairo_clip (cr);
+    cairo_paint_with_alpha (cr, alpha);
+    cairo_pattern_destroy (pat);
+    cairo_destroy (cr);
+}
+
+void CrossfadeBenchmark::preScaled (double alpha) {
+    cairo_t *cr = cairo_create (target);
+    cairo_set_source_surface (cr, scaled, 0, 0);
+    cairo_pattern_set_filter (cairo_get_source (cr), CAIRO_FILTER_FAST);
+    cairo_rectangle (cr, 0, 0, width, height);
+    if (alpha < 0.995) {
+        cairo_clip (cr);
+        cairo_paint_with_alpha (cr, alpha);
+    } else {
+        cairo_fill (cr);
+    }
+    cairo_destroy (cr);
+}
+
+void CrossfadeBenchmark::crossfade_data () {
+    QTest::addColumn <bool> ("prescaled");
+    QTest::addColumn <double> ("alpha");
+    QTest::newRow ("scaling pattern, alpha 0.5") << false << 0.5;
+    QTest::newRow ("pre-scaled, alpha 0.5") << true << 0.5;
+    QTest::newRow ("scaling pattern, opaque") << false << 1.0;
+    QTest::newRow ("pre-scaled, opaque") << true << 1.0;
+}
+
+void CrossfadeBenchmark::crossfade () {
+    QFETCH (bool, prescaled);
+    QFETCH (double, alpha);
+    qint64 frames = 0;
+    QElapsedTimer timer;
+    timer.start ();
+    QBENCHMARK {
+        if (prescaled)
+            preScaled (alpha);
+        else
+            scaledPattern (alpha);
+        cairo_surface_flush (target);
+        ++frames;
+    }
+    const qint64 ns = qMax ((qint64) 1, timer.nsecsElapsed ());
+    qInfo ("%.1f MP/s", 1e3 * frames * width * height / ns);
+}
+
+QTEST_GUILESS_MAIN (CrossfadeBenchmark)
+
+#include "crossfadebenchmark.moc"
@@ -0,0 +1,158 @@
+/*
+    This file belong to the KMPlayer project, a movie player plugin for Konqueror
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include <QtTest>
+#include <QDir>
+#include <QMimeDatabase>
+
+#include "mimesniff.h"
+
+using namespace KMPlayer;
+
+/**
+ * sniffMime against the magic of each known format, the sample documents
+ * in tests/ and look-alikes that must fall through to QMimeDatabase.
+ */
+class MimeSniffTest : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void initTestCase ();
+    void magic_data ();
+    void magic ();
+    void samples_data ();
+    void samples ();
+    void benchmark_data ();
+    void benchmark ();
+private:
+    QList <QByteArray> corpus;
+};
+
+static QByteArray bytes (const char *s, int len) {
+    return QByteArray (s, len);
+}
+
+void MimeSniffTest::initTestCase () {
+    QDir dir (KMPLAYER_TEST_DATA);
+    const QStringList files = dir.entryList (QDir::Files);
+    for (const QString &f : files) {
+        QFile file (dir.filePath (f));
+        if (file.open (QIODevice::ReadOnly))
+            corpus << file.read (1024);
+    }
+    QVERIFY (!corpus.isEmpty ());
+}
+
+void MimeSniffTest::magic_data () {
+    QTest::addColumn <QByteArray> ("data");
+    QTest::addColumn <QString> ("mime");
+
+    QTest::newRow ("png") << bytes ("\x89PNG\r\n\x1a\n\0\0\0\rIHDR", 16)
+        << "image/png";
+    QTest::newRow ("jpeg") << bytes ("\xff\xd8\xff\xe0\0\x10JFIF", 10)
+        << "image/jpeg";
+    QTest::newRow ("gif87a") << QByteArray ("GIF87a\x01\0") << "image/gif";
+    QTest::newRow ("gif89a") << QByteArray ("GIF89a\x01\0") << "image/gif";
+    QTest::newRow ("webp") << bytes ("RIFF\0\0\0\0WEBPVP8 ", 16)
+        << "image/webp";
+    QTest::newRow ("avi") << bytes ("RIFF\0\0\0\0AVI LIST", 16)
+        << "video/x-msvideo";
+    QTest::newRow ("wav") << bytes ("RIFF\0\0\0\0WAVEfmt ", 16)
+        << "audio/x-wav";
+    QTest::newRow ("asf") << bytes ("\x30\x26\xb2\x75\x8e\x66\xcf\x11\xa6\xd9", 10)
+        << "application/vnd.ms-asf";
+    QTest::newRow ("flv") << bytes ("FLV\x01\x05\0\0\0\x09", 9) << "video/x-flv";
+    QTest::newRow ("mpeg ps") << bytes ("\0\0\x01\xba\x44\0", 6) << "video/mpeg";
+    QTest::newRow ("mp3 id3") << QByteArray ("ID3\x03\0\0") << "audio/mpeg";
+    QTest::newRow ("flac") << QByteArray ("fLaC\0\0\0\x22") << "audio/flac";
+    QTest::newRow ("realmedia") << bytes (".RMF\0\0\0\x12", 8)
+        << "application/vnd.rn-realmedia";
+    QTest::newRow ("swf") << QByteArray ("FWS\x09") << "application/x-shockwave-flash";
+    QTest::newRow ("swf compressed") << QByteArray ("CWS\x09")
+        << "application/x-shockwave-flash";
+    QTest::newRow ("m3u") << QByteArray ("#EXTM3U\n#EXTINF:1,a\na.mp3\n")
+        << "audio/x-mpegurl";
+    QTest::newRow ("pls") << QByteArray ("\r\n  [Playlist]\nFile1=a.mp3\n")
+        << "audio/x-scpls";
+    QTest::newRow ("smil prolog") << QByteArray (
+            "<?xml version=\"1.0\"?>\n<!DOCTYPE smil>\n<smil><body/></smil>")
+        << "application/smil+xml";
+    QTest::newRow ("smil bom comment") << QByteArray (
+            "\xef\xbb\xbf<!-- a -- b -->\n<smil xmlns=\"x\">")
+        << "application/smil+xml";
+    QTest::newRow ("rss") << QByteArray ("<rss version=\"2.0\">") << "application/rss+xml";
+    QTest::newRow ("atom") << QByteArray ("<feed xmlns=\"http://www.w3.org/2005/Atom\">")
+        << "application/atom+xml";
+    QTest::newRow ("xspf") << QByteArray ("<playlist version=\"1\">")
+        << "application/xspf+xml";
+    QTest::newRow ("asx upper case") << QByteArray ("<ASX version=\"3.0\">")
+        << "audio/x-ms-asx";
+    QTest::newRow ("svg") << QByteArray ("<svg width=\"10\"/>") << "image/svg+xml";
+
+    QTest::newRow ("empty") << QByteArray () << QString ();
+    QTest::newRow ("riff truncated") << QByteArray ("RIFF\0\0") << QString ();
+    QTest::newRow ("riff other") << bytes ("RIFF\0\0\0\0CDXA", 12) << QString ();
+    QTest::newRow ("look-alike root") << QByteArray ("<smiley/>") << QString ();
+    QTest::newRow ("html") << QByteArray ("<html><body/></html>") << QString ();
+    QTest::newRow ("unterminated comment") << QByteArray ("<!-- <smil>")
+        << QString ();
+    QTest::newRow ("text") << QByteArray ("Chapter 2.") << QString ();
+}
+
+void MimeSniffTest::magic () {
+    QFETCH (QByteArray, data);
+    QFETCH (QString, mime);
+    QCOMPARE (QString::fromLatin1 (sniffMime (data)), mime);
+}
+
+void MimeSniffTest::samples_data () {
+    QTest::addColumn <QString> ("file");
+    QTest::addColumn <QString> ("mime");
+
+    QDir dir (KMPLAYER_TEST_DATA);
+    const QStringList files = dir.entryList (QStringList () << "*.smil");
+    for (const QString &f : files)
+        QTest::newRow (f.toLatin1 ().constData ()) << f
+            << "application/smil+xml";
+    QTest::newRow ("wheel.svg") << "wheel.svg" << "image/svg+xml";
+    QTest::newRow ("fade.rp") << "fade.rp" << QString ();
+    QTest::newRow ("books.xml") << "books.xml" << QString ();
+    QTest::newRow ("smil_files.m3u") << "smil_files.m3u" << QString ();
+    QTest::newRow ("some_text.html") << "some_text.html" << QString ();
+    QTest::newRow ("chapter2.txt") << "chapter2.txt" << QString ();
+}
+
+void MimeSniffTest::samples () {
+    QFETCH (QString, file);
+    QFETCH (QString, mime);
+    QFile f (QDir (KMPLAYER_TEST_DATA).filePath (file));
+    QVERIFY (f.open (QIODevice::ReadOnly));
+    QCOMPARE (QString::fromLatin1 (sniffMime (f.read (1024))), mime);
+}
+
+void MimeSniffTest::benchmark_data () {
+    QTest::addColumn <bool> ("database");
+    QTest::newRow ("sniffMime") << false;
+    QTest::newRow ("QMimeDatabase") << true;
+}
+
+void MimeSniffTest::benchmark () {
+    QFETCH (bool, database);
+    QMimeDatabase db;
+    int found = 0;
+    QBENCHMARK {
+        for (const QByteArray &data : corpus)
+            if (database)
+                found += db.mimeTypeForData (data).isDefault () ? 0 : 1;
+            else
+                found += sniffMime (data) ? 1 : 0;
+    }
+    QVERIFY (found > 0);
+}
+
+QTEST_GUILESS_MAIN (MimeSniffTest)
+
+#include "mimesnifftest.moc"
@@ -0,0 +1,194 @@
+/*
+    This file belong to the KMPlayer project, a movie player plugin for Konqueror
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include <string.h>
+
+#include <QtTest>
+#include <QRegExp>
+
+#include "mplayeroutput.h"
+
+using namespace KMPlayer;
+
+namespace {
+
+/* What MPlayer::processOutput takes from a log */
+struct Replay {
+    double length = -1.0;
+    int width = 0;
+    int height = 0;
+    double aspect = 0.0;
+    double position = -1.0;
+    double fill = -1.0;
+    int languages = 0;
+    int status_lines = 0;
+};
+
+}
+
+/**
+ * The mplayer output parsers, and a replay of an mplayer -identify log
+ * through them the way MPlayer::processOutput splits its reads.
+ */
+class MPlayerOutputTest : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void initTestCase ();
+    void parseNumber_data ();
+    void parseNumber ();
+    void replay ();
+    void replayBenchmark_data ();
+    void replayBenchmark ();
+private:
+    void replayLog (Replay &r, bool patterns);
+    QByteArray log;
+};
+
+void MPlayerOutputTest::initTestCase () {
+    QFile file (KMPLAYER_TEST_LOG);
+    QVERIFY (file.open (QIODevice::ReadOnly));
+    log = file.readAll ();
+}
+
+void MPlayerOutputTest::parseNumber_data () {
+    QTest::addColumn <QByteArray> ("text");
+    QTest::addColumn <bool> ("comma");
+    QTest::addColumn <bool> ("ok");
+    QTest::addColumn <double> ("value");
+
+    QTest::newRow ("integer") << QByteArray ("1280") << false << true << 1280.0;
+    QTest::newRow ("fraction") << QByteArray ("12.5") << false << true << 12.5;
+    QTest::newRow ("spaces") << QByteArray ("  7 \t") << false << true << 7.0;
+    QTest::newRow ("negative") << QByteArray ("-3.25") << false << true << -3.25;
+    QTest::newRow ("plus") << QByteArray ("+2") << false << true << 2.0;
+    QTest::newRow ("zero") << QByteArray ("0.0000") << false << true << 0.0;
+    QTest::newRow ("exponent") << QByteArray ("1e+03") << false << true << 1000.0;
+    QTest::newRow ("exponent fraction") << QByteArray ("1.8e+03") << false
+        << true << 1800.0;
+    QTest::newRow ("exponent negative") << QByteArray ("-25E-1") << false
+        << true << -2.5;
+    QTest::newRow ("exponent comma") << QByteArray ("1,5e2") << true
+        << true << 150.0;
+    QTest::newRow ("decimal comma") << QByteArray ("1,7778") << true
+        << true << 1.7778;
+    QTest::newRow ("comma not asked") << QByteArray ("1,7778") << false
+        << false << 0.0;
+    QTest::newRow ("exponent only") << QByteArray ("e5") << false << false << 0.0;
+    QTest::newRow ("exponent missing") << QByteArray ("1e") << false
+        << false << 0.0;
+    QTest::newRow ("text") << QByteArray ("eng") << false << false << 0.0;
+    QTest::newRow ("empty") << QByteArray () << false << false << 0.0;
+}
+
+void MPlayerOutputTest::parseNumber () {
+    QFETCH (QByteArray, text);
+    QFETCH (bool, comma);
+    QFETCH (bool, ok);
+    QFETCH (double, value);
+    double v = 0.0;
+    const char *s = text.constData ();
+    QCOMPARE (KMPlayer::parseNumber (s, s + text.size (), v, comma), ok);
+    if (ok)
+        QCOMPARE (v, value);
+}
+
+void MPlayerOutputTest::replayLog (Replay &r, bool patterns) {
+    QRegExp pos_pattern ("[AV]:\\s*([0-9\\.]+)");
+    QRegExp cache_pattern ("Cache fill:[^0-9]*([0-9\\.]+)%");
+    const char *str = log.constData ();
+    int slen = log.size ();
+    while (slen > 0) {
+        const int len = strcspn (str, "\r\n");
+        const char *line = str;
+        const char *line_end = line + len;
+        if (len >= slen)
+            break;
+        const bool status = str[len] == '\r' &&
+            !(len + 1 < slen && str[len + 1] == '\n');
+        const int skip = len + (status || str[len] == '\n' ? 1 : 2);
+        str += skip;
+        slen -= skip;
+
+        if (status) {
+            ++r.status_lines;
+            if (patterns) {
+                const QString out = QString::fromLocal8Bit (line, len);
+                if (pos_pattern.indexIn (out) > -1)
+                    r.position = pos_pattern.cap (1).toDouble ();
+                else if (cache_pattern.indexIn (out) > -1)
+                    r.fill = cache_pattern.cap (1).toDouble ();
+            } else {
+                double v;
+                if (statusPosition (line, len, v))
+                    r.position = v;
+                else if (statusCacheFill (line, len, v))
+                    r.fill = v;
+            }
+            continue;
+        }
+        MPlayerLine kind;
+        const char *value;
+        if (!mplayerLine (line, len, kind, value) || !value)
+            continue;
+        switch (kind) {
+        case LineLength:
+            KMPlayer::parseNumber (value, line_end, r.length);
+            break;
+        case LineVideoWidth:
+            r.width = parseInt (value, line_end);
+            break;
+        case LineVideoHeight:
+            r.height = parseInt (value, line_end);
+            break;
+        case LineVideoAspect:
+            KMPlayer::parseNumber (value, line_end, r.aspect, true);
+            break;
+        case LineAudioLang:
+        case LineSubtitleLang:
+            ++r.languages;
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+void MPlayerOutputTest::replay () {
+    Replay r;
+    replayLog (r, false);
+    QCOMPARE (r.length, 1800.0);
+    QCOMPARE (r.width, 1280);
+    QCOMPARE (r.height, 720);
+    QCOMPARE (r.aspect, 1.7778);
+    QCOMPARE (r.position, 60.0);
+    QCOMPARE (r.fill, 95.0);
+    QCOMPARE (r.languages, 3);
+
+    Replay p;
+    replayLog (p, true);
+    QCOMPARE (p.status_lines, r.status_lines);
+    QCOMPARE (p.position, r.position);
+    QCOMPARE (p.fill, r.fill);
+}
+
+void MPlayerOutputTest::replayBenchmark_data () {
+    QTest::addColumn <bool> ("patterns");
+    QTest::newRow ("parsers") << false;
+    QTest::newRow ("QRegExp patterns") << true;
+}
+
+void MPlayerOutputTest::replayBenchmark () {
+    QFETCH (bool, patterns);
+    QBENCHMARK {
+        Replay r;
+        replayLog (r, patterns);
+    }
+}
+
+QTEST_GUILESS_MAIN (MPlayerOutputTest)
+
+#include "mplayeroutputtest.moc"
@@ -0,0 +1,155 @@
+/*
+    This file belong to the KMPlayer project, a movie player plugin for Konqueror
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+#include <QtTest>
+
+#include <xcb/xcb.h>
+#include <xcb/shm.h>
+
+/**
+ * Frame presentation through a MIT-SHM segment the way ViewArea does it,
+ * 1280x720 frames with a frame's worth of other GUI work in between.
+ * Compares waiting for the server with a round trip right after the put,
+ * to overlapping that work with the server read and waiting for the
+ * ShmCompletion event only before painting the next frame.
+ */
+class ShmPresentBenchmark : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void initTestCase ();
+    void cleanupTestCase ();
+    void presentRoundTrip ();
+    void presentCompletion ();
+private:
+    void paint ();
+    void put (bool send_event);
+    void otherWork ();
+    void waitCompletion ();
+
+    xcb_connection_t *connection = nullptr;
+    xcb_window_t window = 0;
+    xcb_gcontext_t gc = 0;
+    xcb_shm_seg_t seg = 0;
+    unsigned char *data = nullptr;
+    uint8_t depth = 0;
+    uint8_t event_base = 0;
+    unsigned frame = 0;
+    QByteArray scratch;
+};
+
+static const int width = 1280;
+static const int height = 720;
+
+void ShmPresentBenchmark::initTestCase () {
+    connection = xcb_connect (nullptr, nullptr);
+    if (xcb_connection_has_error (connection)) {
+        xcb_disconnect (connection);
+        connection = nullptr;
+        QSKIP ("no X display, run under Xvfb");
+    }
+    const xcb_query_extension_reply_t *ext =
+        xcb_get_extension_data (connection, &xcb_shm_id);
+    if (!ext || !ext->present)
+        QSKIP ("X server without MIT-SHM");
+    event_base = ext->first_event;
+
+    xcb_screen_t *scr = xcb_setup_roots_iterator (
+            xcb_get_setup (connection)).data;
+    depth = scr->root_depth;
+    window = xcb_generate_id (connection);
+    xcb_create_window (connection, XCB_COPY_FROM_PARENT, window, scr->root,
+            0, 0, width, height, 0, XCB_WINDOW_CLASS_INPUT_OUTPUT,
+            scr->root_visual, 0, nullptr);
+    xcb_map_window (connection, window);
+    gc = xcb_generate_id (connection);
+    xcb_create_gc (connection, gc, window, 0, nullptr);
+
+    int id = shmget (IPC_PRIVATE, width * height * 4, IPC_CREAT | 0600);
+    QVERIFY (id >= 0);
+    data = (unsigned char *) shmat (id, nullptr, 0);
+    seg = xcb_generate_id (connection);
+    xcb_generic_error_t *error = xcb_request_check (connection,
+            xcb_shm_attach_checked (connection, seg, id, 0));
+    shmctl (id, IPC_RMID, nullptr);
+    if (error) {
+        free (error);
+        QSKIP ("MIT-SHM attach failed, remote display?");
+    }
+    scratch.resize (width * height * 4);
+}
+
+void ShmPresentBenchmark::cleanupTestCase () {
+    if (!connection)
+        return;
+    if (seg)
+        xcb_shm_detach (connection, seg);
+    if (data && data != (void *) -1)
+        shmdt (data);
+    xcb_disconnect (connection);
+}
+
+void ShmPresentBenchmark::paint () {
+    memset (data, ++frame & 0xff, width * height * 4);
+}
+
+void ShmPresentBenchmark::put (bool send_event) {
+    xcb_shm_put_image (connection, window, gc, width, height, 0, 0,
+            width, height, 0, 0, depth, XCB_IMAGE_FORMAT_Z_PIXMAP,
+            send_event, seg, 0);
+    xcb_flush (connection);
+}
+
+void ShmPresentBenchmark::otherWork () {
+    // stands in for the updaters and decoding between two frames
+    char *p = scratch.data ();
+    for (int i = 0; i < scratch.size (); i += 64)
+        p[i] = (char) (p[i] * 31 + i);
+}
+
+void ShmPresentBenchmark::waitCompletion () {
+    while (xcb_generic_event_t *event = xcb_wait_for_event (connection)) {
+        const bool done = (event->response_type & ~0x80) ==
+            event_base + XCB_SHM_COMPLETION;
+        free (event);
+        if (done)
+            return;
+    }
+    QFAIL ("X connection lost");
+}
+
+void ShmPresentBenchmark::presentRoundTrip () {
+    QBENCHMARK {
+        paint ();
+        put (false);
+        free (xcb_get_input_focus_reply (connection,
+                    xcb_get_input_focus (connection), nullptr));
+        otherWork ();
+    }
+}
+
+void ShmPresentBenchmark::presentCompletion () {
+    bool pending = false;
+    QBENCHMARK {
+        if (pending)
+            waitCompletion ();
+        paint ();
+        put (true);
+        pending = true;
+        otherWork ();
+    }
+    if (pending)
+        waitCompletion ();
+}
+
+QTEST_GUILESS_MAIN (ShmPresentBenchmark)
+
+#include "shmpresentbenchmark.moc"
@@ -0,0 +1,141 @@
+/*
+    This file belong to the KMPlayer project, a movie player plugin for Konqueror
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include <QtTest>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QImage>
+#include <QPainter>
+#include <QRunnable>
+#include <QSet>
+#include <QSvgRenderer>
+#include <QThreadPool>
+
+/**
+ * GUI thread time of resizing an SVG image in 60 steps, like dragging a
+ * window edge. Compares rendering every size on the GUI thread, as before,
+ * to what ImageMedia::render does now with an SvgRasterCache: round up to
+ * a size bucket, show the nearest raster and render the bucket on a
+ * worker in bands, like SvgRenderJob, dropping a render that got stale.
+ */
+class SvgRasterBenchmark : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void initTestCase ();
+    void resize_data ();
+    void resize ();
+private:
+    QByteArray xml;
+};
+
+namespace {
+
+/* SvgRenderJob, cancelled when the serial it was started for is stale */
+class RenderJob : public QRunnable {
+public:
+    RenderJob (const QByteArray &x, const QSize &s, QAtomicInt *c, int i)
+     : xml (x), size (s), current (c), id (i) {}
+    void run () override {
+        if (current->loadAcquire () != id)
+            return;
+        QSvgRenderer renderer (xml);
+        QImage img (size, QImage::Format_ARGB32_Premultiplied);
+        img.fill (0x0);
+        QPainter paint (&img);
+        paint.setViewport (QRect (QPoint (), size));
+        for (int y = 0; y < size.height (); y += 128) {
+            if (current->loadAcquire () != id)
+                return;
+            paint.setClipRect (0, y, size.width (), 128);
+            renderer.render (&paint);
+        }
+    }
+    QByteArray xml;
+    QSize size;
+    QAtomicInt *current;
+    int id;
+};
+
+}
+
+/* SvgRasterCache::bucket */
+static QSize bucket (const QSize &size) {
+    int w = qMax (1, size.width ());
+    int h = qMax (1, size.height ());
+    int wstep = qMax (8, (int) qNextPowerOfTwo ((quint32) w) / 16);
+    int hstep = qMax (8, (int) qNextPowerOfTwo ((quint32) h) / 16);
+    return QSize ((w + wstep - 1) / wstep * wstep,
+            (h + hstep - 1) / hstep * hstep);
+}
+
+static QSize step (int i) {
+    return QSize (400 + 10 * i, 300 + 7 * i);
+}
+
+static const int steps = 60;
+
+void SvgRasterBenchmark::initTestCase () {
+    xml = "<svg xmlns=\"http://www.w3.org/2000/svg\" viewBox=\"0 0 400 300\">"
+        "<defs><radialGradient id=\"g\"><stop offset=\"0\" stop-color=\"#fc0\"/>"
+        "<stop offset=\"1\" stop-color=\"#06c\"/></radialGradient></defs>";
+    for (int i = 0; i < 400; ++i)
+        xml += QString ("<path fill=\"url(#g)\" fill-opacity=\"0.6\" "
+                "stroke=\"#333\" d=\"M%1,%2 q40,-60 80,0 t80,0 l-40,50 z\"/>")
+            .arg ((i * 37) % 360).arg ((i * 53) % 280).toLatin1 ();
+    xml += "</svg>";
+    QVERIFY (QSvgRenderer (xml).isValid ());
+}
+
+void SvgRasterBenchmark::resize_data () {
+    QTest::addColumn <bool> ("cached");
+    QTest::newRow ("render each size") << false;
+    QTest::newRow ("bucketed, in background") << true;
+}
+
+void SvgRasterBenchmark::resize () {
+    QFETCH (bool, cached);
+    QSvgRenderer renderer (xml);
+    QThreadPool pool;
+    QAtomicInt current;
+    QSet <quint64> rendered;
+    QSize pending;
+    int serial = 0;
+    int renders = 0;
+
+    QElapsedTimer gui;
+    gui.start ();
+    for (int i = 0; i < steps; ++i) {
+        const QSize size = step (i);
+        if (!cached) {
+            QImage img (size, QImage::Format_ARGB32_Premultiplied);
+            img.fill (0x0);
+            QPainter paint (&img);
+            paint.setViewport (QRect (QPoint (), size));
+            renderer.render (&paint);
+            ++renders;
+            continue;
+        }
+        const QSize b = bucket (size);
+        const quint64 key = (quint64) b.width () << 32 | b.height ();
+        if (rendered.contains (key) || pending == b)
+            continue; // shown from the cache, or the nearest meanwhile
+        rendered.insert (key);
+        pending = b;
+        current.storeRelease (++serial); // cancels the stale render
+        pool.start (new RenderJob (xml, b, &current, serial));
+        ++renders;
+    }
+    const qint64 ns = gui.nsecsElapsed ();
+    pool.waitForDone ();
+    QTest::setBenchmarkResult (1e-6 * ns, QTest::WalltimeMilliseconds);
+    qInfo ("%d resize steps, %d rasterisations started, %.2f ms GUI thread "
+            "per step", steps, renders, 1e-6 * ns / steps);
+}
+
+QTEST_GUILESS_MAIN (SvgRasterBenchmark)
+
+#include "svgrasterbenchmark.moc"
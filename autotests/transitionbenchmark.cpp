@@ -0,0 +1,156 @@
+/*
+    This file belong to the KMPlayer project, a movie player plugin for Konqueror
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include <math.h>
+
+#include <QtTest>
+#include <QElapsedTimer>
+#include <QMap>
+
+#include <cairo.h>
+
+/**
+ * Frame time of a one second clockWipe over a 1280x720 region at 25 fps,
+ * like tests/transition.smil, on an image surface. Compares filling the
+ * wipe's path every frame, as before, to compositing with the alpha masks
+ * CairoPaintVisitor caches per progress step, both when the masks still
+ * have to be rendered and when the transition repeats.
+ */
+class TransitionBenchmark : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void initTestCase ();
+    void cleanupTestCase ();
+    void clockWipe_data ();
+    void clockWipe ();
+private:
+    void clockPath (cairo_t *cr, int w, int h, float perc);
+    void pathFrame (float perc);
+    void maskFrame (float perc);
+    void clearMasks ();
+
+    cairo_surface_t *media = nullptr;
+    cairo_surface_t *target = nullptr;
+    QMap <int, cairo_surface_t *> masks;
+};
+
+static const int width = 1280;
+static const int height = 720;
+static const int frames = 25;
+static const int mask_steps = 64;      // transition_mask_steps
+static const int mask_max_size = 512;  // transition_mask_max_size
+
+void TransitionBenchmark::initTestCase () {
+    media = cairo_image_surface_create (CAIRO_FORMAT_RGB24, width, height);
+    cairo_t *cr = cairo_create (media);
+    cairo_set_source_rgb (cr, 0.2, 0.5, 0.8);
+    cairo_paint (cr);
+    cairo_destroy (cr);
+    target = cairo_image_surface_create (CAIRO_FORMAT_RGB24, width, height);
+}
+
+void TransitionBenchmark::cleanupTestCase () {
+    clearMasks ();
+    cairo_surface_destroy (target);
+    cairo_surface_destroy (media);
+}
+
+void TransitionBenchmark::clearMasks () {
+    for (cairo_surface_t *sf : qAsConst (masks))
+        cairo_surface_destroy (sf);
+    masks.clear ();
+}
+
+/* transitionPath for SubClockwiseTwelve */
+void TransitionBenchmark::clockPath (cairo_t *cr, int w, int h, float perc) {
+    const int mx = w/2;
+    const int my = h/2;
+    const float hw = 1.0 * w/2;
+    const float hh = 1.0 * h/2;
+    const float radius = sqrtf (hw * hw + hh * hh);
+    const float phi = -M_PI / 2;
+    cairo_move_to (cr, mx, my);
+    cairo_arc (cr, mx, my, radius, phi, phi + 2 * M_PI * perc);
+    cairo_close_path (cr);
+}
+
+void TransitionBenchmark::pathFrame (float perc) {
+    cairo_t *cr = cairo_create (target);
+    cairo_rectangle (cr, 0, 0, width, height);
+    cairo_clip (cr);
+    cairo_new_path (cr);
+    clockPath (cr, width, height, perc);
+    cairo_set_source_surface (cr, media, 0, 0);
+    cairo_fill (cr);
+    cairo_destroy (cr);
+}
+
+void TransitionBenchmark::maskFrame (float perc) {
+    const float scale = 1.0 * mask_max_size / qMax (width, height);
+    const int step = (int) (perc * mask_steps + 0.5);
+    cairo_surface_t *sf = masks.value (step);
+    if (!sf) {
+        sf = cairo_image_surface_create (CAIRO_FORMAT_A8,
+                (int) ceil (scale * width), (int) ceil (scale * height));
+        cairo_t *cr_mask = cairo_create (sf);
+        cairo_scale (cr_mask, scale, scale);
+        clockPath (cr_mask, width, height, 1.0 * step / mask_steps);
+        cairo_set_source_rgba (cr_mask, 0, 0, 0, 1.0);
+        cairo_fill (cr_mask);
+        cairo_destroy (cr_mask);
+        masks.insert (step, sf);
+    }
+    cairo_t *cr = cairo_create (target);
+    cairo_rectangle (cr, 0, 0, width, height);
+    cairo_clip (cr);
+    cairo_set_source_surface (cr, media, 0, 0);
+    cairo_matrix_t mat;
+    cairo_matrix_init_scale (&mat, scale, scale);
+    cairo_pattern_t *mask = cairo_pattern_create_for_surface (sf);
+    cairo_pattern_set_matrix (mask, &mat);
+    cairo_pattern_set_filter (mask, CAIRO_FILTER_BILINEAR);
+    cairo_mask (cr, mask);
+    cairo_pattern_destroy (mask);
+    cairo_destroy (cr);
+}
+
+void TransitionBenchmark::clockWipe_data () {
+    QTest::addColumn <bool> ("masked");
+    QTest::addColumn <bool> ("cached");
+    QTest::newRow ("path per frame") << false << false;
+    QTest::newRow ("mask, first run") << true << false;
+    QTest::newRow ("mask, repeated") << true << true;
+}
+
+void TransitionBenchmark::clockWipe () {
+    QFETCH (bool, masked);
+    QFETCH (bool, cached);
+    clearMasks ();
+    if (cached)
+        for (int i = 0; i <= frames; ++i)
+            maskFrame (1.0 * i / frames);
+    qint64 runs = 0;
+    QElapsedTimer timer;
+    timer.start ();
+    QBENCHMARK {
+        if (!cached)
+            clearMasks ();
+        for (int i = 0; i <= frames; ++i)
+            if (masked)
+                maskFrame (1.0 * i / frames);
+            else
+                pathFrame (1.0 * i / frames);
+        cairo_surface_flush (target);
+        ++runs;
+    }
+    const qint64 ns = qMax ((qint64) 1, timer.nsecsElapsed ());
+    qInfo ("%.3f ms/frame", 1e-6 * ns / (runs * (frames + 1)));
+}
+
+QTEST_GUILESS_MAIN (TransitionBenchmark)
+
+#include "transitionbenchmark.moc"
@@ -0,0 +1,109 @@
+/*
+    This file belong to the KMPlayer project, a movie player plugin for Konqueror
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include <QtTest>
+#include <QTemporaryDir>
+
+#include "kmplayerplaylist.h"
+#include "mediaobject.h"
+
+using namespace KMPlayer;
+
+namespace {
+
+/* A document that answers the MediaManager role, as a PartBase's does */
+class BenchDocument : public Document
+{
+public:
+    BenchDocument (MediaManager *mgr) : Document (QString ()), manager (mgr) {}
+    void *role (RoleType msg, void *content=nullptr) override {
+        if (RoleMediaManager == msg)
+            return manager;
+        return Document::role (msg, content);
+    }
+    MediaManager *manager;
+};
+
+}
+
+/**
+ * Time until MediaInfo::wget of a large local playlist returns ready,
+ * ie. including parsing it into child nodes. These files are read
+ * from a mapping.
+ */
+class WGetBenchmark : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void initTestCase ();
+    void cleanupTestCase ();
+    void timeToReady_data ();
+    void timeToReady ();
+private:
+    QTemporaryDir dir;
+    MediaManager *manager = nullptr;
+    NodePtr doc;
+};
+
+void WGetBenchmark::initTestCase () {
+    QVERIFY (dir.isValid ());
+    QFile m3u (dir.filePath ("list.m3u"));
+    QVERIFY (m3u.open (QIODevice::WriteOnly));
+    m3u.write ("#EXTM3U\n");
+    for (int i = 0; i < 20000; ++i)
+        m3u.write (QString ("#EXTINF:180,Artist %1 - Title %1\n"
+                    "http://example.org/music/track%1.mp3\n")
+                .arg (i).toUtf8 ());
+    m3u.close ();
+    QFile smil (dir.filePath ("list.smil"));
+    QVERIFY (smil.open (QIODevice::WriteOnly));
+    smil.write ("<smil><body><seq>\n");
+    for (int i = 0; i < 20000; ++i)
+        smil.write (QString ("<video src=\"clip%1.mpg\" dur=\"2s\"/>\n")
+                .arg (i).toUtf8 ());
+    smil.write ("</seq></body></smil>\n");
+    smil.close ();
+
+    manager = new MediaManager (nullptr);
+    doc = new BenchDocument (manager);
+}
+
+void WGetBenchmark::cleanupTestCase () {
+    if (doc)
+        doc->document ()->dispose ();
+    doc = nullptr;
+    delete manager;
+}
+
+void WGetBenchmark::timeToReady_data () {
+    QTest::addColumn <QString> ("file");
+    QTest::addColumn <int> ("type");
+    QTest::newRow ("m3u 20k entries") << "list.m3u" << (int) MediaManager::Audio;
+    QTest::newRow ("smil 20k elements") << "list.smil" << (int) MediaManager::Any;
+}
+
+void WGetBenchmark::timeToReady () {
+    QFETCH (QString, file);
+    QFETCH (int, type);
+    const QString url = QUrl::fromLocalFile (dir.filePath (file)).toString ();
+    NodePtr item = new GenericURL (doc, url);
+    doc->appendChild (item);
+    MediaInfo *info = new MediaInfo (item, (MediaManager::MediaType) type);
+    QBENCHMARK {
+        item->clearChildren ();
+        item->mrl ()->mimetype.clear ();
+        info->type = (MediaManager::MediaType) type;
+        QVERIFY (info->wget (url));
+    }
+    QVERIFY (item->firstChild ());
+    QVERIFY (info->rawData ().isEmpty ()); // the mapping is released
+    delete info;
+    doc->removeChild (item);
+}
+
+QTEST_GUILESS_MAIN (WGetBenchmark)
+
+#include "wgetbenchmark.moc"
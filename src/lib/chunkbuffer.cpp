@@ -0,0 +1,67 @@
+/*
+    This file belong to the KMPlayer project, a movie player plugin for Konqueror
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include <string.h>
+
+#include <QIODevice>
+
+#include "chunkbuffer.h"
+
+using namespace KMPlayer;
+
+void ChunkBuffer::append (const QByteArray &chunk) {
+    if (chunk.size ()) {
+        chunks.append (chunk);
+        total += chunk.size ();
+    }
+}
+
+void ChunkBuffer::clear () {
+    chunks.clear ();
+    total = 0;
+}
+
+/*
+ * At least the first len bytes contiguous, or all when there are less.
+ * Shares the first chunk if that one is large enough.
+ */
+QByteArray ChunkBuffer::head (int len) const {
+    if (chunks.isEmpty () || chunks.first ().size () >= len)
+        return chunks.isEmpty () ? QByteArray () : chunks.first ();
+    QByteArray ba;
+    ba.reserve (qMin (len, total));
+    for (int i = 0; i < chunks.size () && ba.size () < len; ++i)
+        ba.append (chunks[i].constData (), qMin (chunks[i].size (), len - ba.size ()));
+    return ba;
+}
+
+/* Joins all chunks into one, copying only once and only if more than one */
+QByteArray ChunkBuffer::flatten () {
+    if (chunks.size () > 1) {
+        QByteArray ba (total, Qt::Uninitialized);
+        char *p = ba.data ();
+        for (int i = 0; i < chunks.size (); ++i) {
+            memcpy (p, chunks[i].constData (), chunks[i].size ());
+            p += chunks[i].size ();
+        }
+        chunks.clear ();
+        chunks.append (ba);
+    }
+    return chunks.isEmpty () ? QByteArray () : chunks.first ();
+}
+
+qint64 ChunkBuffer::writeTo (QIODevice *dev) const {
+    qint64 written = 0;
+    for (int i = 0; i < chunks.size (); ++i) {
+        qint64 n = dev->write (chunks[i]);
+        if (n < 0)
+            return written ? written : n;
+        written += n;
+        if (n < chunks[i].size ())
+            break;
+    }
+    return written;
+}
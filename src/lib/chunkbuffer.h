@@ -0,0 +1,42 @@
+/*
+    This file belong to the KMPlayer project, a movie player plugin for Konqueror
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#ifndef _KMPLAYER_CHUNKBUFFER_H_
+#define _KMPLAYER_CHUNKBUFFER_H_
+
+#include <QByteArray>
+#include <QList>
+
+class QIODevice;
+
+namespace KMPlayer {
+
+/*
+ * Received data kept as the chunks it arrived in, so appending shares
+ * instead of copies. Only flattened when contiguous memory is needed.
+ */
+class ChunkBuffer
+{
+public:
+    ChunkBuffer () : total (0) {}
+
+    void append (const QByteArray &chunk);
+    void clear ();
+    int size () const { return total; }
+    bool isEmpty () const { return !total; }
+
+    QByteArray head (int len) const;
+    QByteArray flatten ();
+    qint64 writeTo (QIODevice *dev) const;
+
+private:
+    QList <QByteArray> chunks;
+    int total;
+};
+
+}
+
+#endif
@@ -1732,10 +1732,13 @@ void SMIL::Layout::message (MessageType msg, void *content) {
 
 //-----------------------------------------------------------------------------
 
+static unsigned int region_document_order;
+
 SMIL::RegionBase::RegionBase (NodePtr & d, short id)
  : Element (d, id),
    media_info (nullptr),
-   z_order (0)
+   z_order (0),
+   document_order (++region_document_order) // parser creates in doc order
 {}
 
 SMIL::RegionBase::~RegionBase () {
@@ -1794,49 +1797,8 @@ void SMIL::RegionBase::repaint (const SRect & rect) {
 }
 
 static void updateSurfaceSort (SMIL::RegionBase *rb) {
-    Surface *rs = rb->region_surface.ptr ();
-    Surface *prs = rs->parentNode ();
-    Surface *next = nullptr;
-    if (!prs)
-        return;
-    for (Surface *s = prs->firstChild (); s; s = s->nextSibling ())
-        if (s != rs && s->node) {
-            if (SMIL::id_node_region == s->node->id) {
-                SMIL::Region *r = static_cast <SMIL::Region *> (s->node.ptr ());
-                if (r->z_order > rb->z_order) {
-                    next = s;
-                    break;
-                } else if (r->z_order == rb->z_order) {
-                    next = s;
-                    // now take region order into account
-                    Node *n = rb->previousSibling();
-                    for (; n; n = n->previousSibling())
-                        if (n->id == SMIL::id_node_region) {
-                            r = static_cast <SMIL::Region *> (n);
-                            if (r->region_surface && r->z_order == rb->z_order) {
-                                next = r->region_surface->nextSibling ();
-                                if (rs == next)
-                                    next = next->nextSibling ();
-                                break;
-                            }
-                        }
-                    break;
-                }
-            } else if (SMIL::id_node_root_layout != s->node->id) {
-                // break at attached media types
-                Surface *m = (Surface *) s->node->role (RoleDisplay);
-                if (m) {
-                    next = m;
-                    break;
-                }
-            }
-        }
-    if (rs->nextSibling () == next) {
-        return;
-    }
-    SurfacePtr protect (rs);
-    prs->removeChild (rs);
-    prs->insertBefore (rs, next);
+    rb->region_surface->setZOrder (
+            Surface::ZOrder (rb->z_order, rb->document_order));
 }
 
 void SMIL::RegionBase::parseParam (const TrieString & name, const QString & val) {
@@ -2014,10 +1976,12 @@ void SMIL::RootLayout::message (MessageType msg, void *content) {
                     SMIL::Smil *s = Smil::findSmilNode (this);
                     s->size = surface->bounds.size;
                 }
-                if (content)
+                if (content) {
                     surface->resize (surface->bounds, true);
-                else
+                } else {
+                    surface->boundsChanged ();
                     surface->updateChildren (!!content);
+                }
             }
         }
         return;
@@ -2318,6 +2282,21 @@ public:
     }
 };
 
+/**
+ * Number of upcoming children of a seq for which downloads are requested,
+ * the prefetch scheduler decides when these actually start
+ */
+static const int seq_prefetch_lookahead = 3;
+
+static void prefetchNextSiblings (Node *node) {
+    GroupBaseInitVisitor visitor;
+    int count = 0;
+    for (Node *n = node->nextSibling ();
+            n && count < seq_prefetch_lookahead;
+            n = n->nextSibling (), ++count)
+        n->accept (&visitor);
+}
+
 class FreezeStateUpdater : public Visitor {
 
     bool initial_node;
@@ -2635,10 +2614,7 @@ void SMIL::Seq::begin () {
                     rt->timingstate = Runtime::timings_stopped; //TODO fill_hold
             }
     } else if (firstChild ()) {
-        if (firstChild ()->nextSibling()) {
-            GroupBaseInitVisitor visitor;
-            firstChild ()->nextSibling ()->accept (&visitor);
-        }
+        prefetchNextSiblings (firstChild ());
         starting_connection.connect (firstChild (), MsgEventStarted, this);
         firstChild ()->activate ();
     }
@@ -2669,10 +2645,7 @@ void SMIL::Seq::message (MessageType msg, void *content) {
                         ? post->source->nextSibling ()
                         : nullptr;
                     if (next) {
-                        if (next->nextSibling()) {
-                            GroupBaseInitVisitor visitor;
-                            next->nextSibling ()->accept (&visitor);
-                        }
+                        prefetchNextSiblings (next);
                         starting_connection.connect(next, MsgEventStarted,this);
                         trans_connection.connect (
                                 next, MsgChildTransformedIn, this);
@@ -3282,7 +3255,7 @@ void SMIL::MediaType::closed () {
     Mrl::closed ();
 }
 
-void SMIL::MediaType::prefetch () {
+void SMIL::MediaType::prefetch (bool) {
 }
 
 void SMIL::MediaType::parseParam (const TrieString &para, const QString & val) {
@@ -3294,7 +3267,7 @@ void SMIL::MediaType::parseParam (const TrieString &para, const QString & val) {
             delete media_info;
             media_info = nullptr;
             if (!val.isEmpty () && runtimeBegan (runtime))
-                prefetch ();
+                prefetch (false);
             if (state == state_began && resolved)
                 clipStart ();
         }
@@ -3389,6 +3362,8 @@ void SMIL::MediaType::activate () {
     }
     if (!runtime->started ())
         runtime->start ();
+    if (runtime->begin_timer && !src.isEmpty () && !media_info)
+        prefetch (true); // begin time is known, download ahead
 }
 
 void SMIL::MediaType::deactivate () {
@@ -3401,6 +3376,10 @@ void SMIL::MediaType::deactivate () {
     (void) surface ();
     region_node = nullptr;
     postpone_lock = nullptr;
+    if (media_info && media_info->prefetching ()) {
+        delete media_info; // never began, cancel download
+        media_info = nullptr;
+    }
 }
 
 void SMIL::MediaType::defer () {
@@ -3429,7 +3408,9 @@ void SMIL::MediaType::undefer () {
 
 void SMIL::MediaType::begin () {
     if (!src.isEmpty () && !media_info)
-        prefetch ();
+        prefetch (false);
+    else if (media_info)
+        media_info->claim ();
     if (media_info && media_info->downloading ()) {
         postpone_lock = document ()->postpone ();
         state = state_began;
@@ -3611,7 +3592,7 @@ void SMIL::MediaType::message (MessageType msg, void *content) {
             if (content) {
                 init ();
                 if (!src.isEmpty () && !media_info)
-                    prefetch ();
+                    prefetch (true);
             } else if (media_info) {
                 delete media_info;
                 media_info = nullptr;
@@ -3774,14 +3755,25 @@ Node *SMIL::RefMediaType::childFromTag (const QString & tag) {
     return SMIL::MediaType::childFromTag (tag);
 }
 
-void SMIL::RefMediaType::prefetch () {
+/* Media in the summary a feed generated for one of its items */
+static bool inFeedSummary (Node *node) {
+    SMIL::Smil *smil = SMIL::Smil::findSmilNode (node);
+    return smil && smil->auxiliaryNode ();
+}
+
+void SMIL::RefMediaType::prefetch (bool lookahead) {
     if (!src.isEmpty ()) {
         Node *n = findChildWithId (this, id_node_svg);
         if (n)
             removeChild (n);
-        if (!media_info)
+        if (!media_info) {
             media_info = new MediaInfo (this, MediaManager::Any);
-        resolved = media_info->wget (absolutePath ());
+            media_info->setThumbnail (inFeedSummary (this));
+        }
+        if (lookahead)
+            media_info->prefetch (absolutePath ());
+        else
+            resolved = media_info->wget (absolutePath ());
     }
 }
 
@@ -3849,6 +3841,15 @@ void SMIL::RefMediaType::message (MessageType msg, void *content) {
             return;
         }
 
+        case MsgEventTimer: {
+            TimerPosting *te = static_cast <TimerPosting *> (content);
+            if (ImageMedia::frame_timer_id == te->event_id) {
+                static_cast <ImageMedia *> (media_info->media)->frameTimer ();
+                return;
+            }
+            break;
+        }
+
         case MsgChildFinished:
             if (id_node_svg == ((Posting *) content)->source->id)
                 return;
@@ -3911,10 +3912,13 @@ void SMIL::TextMediaType::init () {
     }
 }
 
-void SMIL::TextMediaType::prefetch () {
+void SMIL::TextMediaType::prefetch (bool lookahead) {
     if (!media_info) {
         media_info = new MediaInfo (this, MediaManager::Text);
-        media_info->wget (absolutePath ());
+        if (lookahead)
+            media_info->prefetch (absolutePath ());
+        else
+            media_info->wget (absolutePath ());
     }
 }
 
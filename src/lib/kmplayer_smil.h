@@ -429,6 +429,7 @@ public:
     CalculatedSizer sizes;
 
     int z_order;
+    unsigned int document_order;             // z_order tie breaker
     SmilColorProperty background_color;
     MediaOpacity media_opacity;
     QString background_image;
@@ -763,7 +764,7 @@ public:
     enum { sens_opaque, sens_transparent, sens_percentage } sensitivity;
 
 protected:
-    virtual void prefetch ();
+    virtual void prefetch (bool lookahead);
     virtual void clipStart ();
     virtual void clipStop ();
 
@@ -786,7 +787,7 @@ public:
     void accept (Visitor *) override;
     void message (MessageType msg, void *content=nullptr) override;
     void *role (RoleType msg, void *content=nullptr) override;
-    void prefetch () override;
+    void prefetch (bool lookahead) override;
     void clipStart () override;
 };
 
@@ -798,7 +799,7 @@ public:
     void init () override;
     void accept (Visitor *) override;
     void parseParam (const TrieString &, const QString &) override;
-    void prefetch () override;
+    void prefetch (bool lookahead) override;
 
     QString font_name;
     int font_size;
@@ -140,6 +140,13 @@ static const char * strURLList = "URL List";
 static const char * strSubURLList = "URL Sub Title List";
 static const char * strPrefBitRate = "Preferred Bitrate";
 static const char * strMaxBitRate = "Maximum Bitrate";
+static const char * strPrefetchBudget = "Prefetch Budget";
+static const char * strPrefetchJobs = "Prefetch Jobs";
+static const char * strImageCacheSize = "Image Cache Size";
+static const char * strMemoryCacheSize = "Memory Cache Size";
+static const char * strDiskCacheSize = "Disk Cache Size";
+static const char * strDownloadJobs = "Download Jobs";
+static const char * strDownloadHostJobs = "Download Jobs Per Host";
 //static const char * strUseArts = "Use aRts";
 static const char * strVoDriver = "Video Driver";
 static const char * strAoDriver = "Audio Driver";
@@ -276,6 +283,13 @@ void Settings::readConfig () {
     sub_urllist = general.readEntry (strSubURLList, QStringList());
     prefbitrate = general.readEntry (strPrefBitRate, 512);
     maxbitrate = general.readEntry (strMaxBitRate, 1024);
+    prefetchbudget = general.readEntry (strPrefetchBudget, 4096);
+    prefetchjobs = general.readEntry (strPrefetchJobs, 2);
+    imagecachesize = general.readEntry (strImageCacheSize, 65536);
+    memorycachesize = general.readEntry (strMemoryCacheSize, 32768);
+    diskcachesize = general.readEntry (strDiskCacheSize, 262144);
+    downloadjobs = general.readEntry (strDownloadJobs, 8);
+    downloadhostjobs = general.readEntry (strDownloadHostJobs, 4);
     volume = general.readEntry (strVolume, 20);
     contrast = general.readEntry (strContrast, 0);
     brightness = general.readEntry (strBrightness, 0);
@@ -538,6 +552,13 @@ void Settings::writeConfig () {
     gen_cfg.writeEntry (strSubURLList, sub_urllist);
     gen_cfg.writeEntry (strPrefBitRate, prefbitrate);
     gen_cfg.writeEntry (strMaxBitRate, maxbitrate);
+    gen_cfg.writeEntry (strPrefetchBudget, prefetchbudget);
+    gen_cfg.writeEntry (strPrefetchJobs, prefetchjobs);
+    gen_cfg.writeEntry (strImageCacheSize, imagecachesize);
+    gen_cfg.writeEntry (strMemoryCacheSize, memorycachesize);
+    gen_cfg.writeEntry (strDiskCacheSize, diskcachesize);
+    gen_cfg.writeEntry (strDownloadJobs, downloadjobs);
+    gen_cfg.writeEntry (strDownloadHostJobs, downloadhostjobs);
     gen_cfg.writeEntry (strVolume, volume);
     gen_cfg.writeEntry (strContrast, contrast);
     gen_cfg.writeEntry (strBrightness, brightness);
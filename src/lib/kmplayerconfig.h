@@ -112,6 +112,13 @@ public:
     int saturation;
     int prefbitrate;
     int maxbitrate;
+    int prefetchbudget;  // KiB held by downloads ahead of begin time
+    int prefetchjobs;
+    int imagecachesize;  // KiB of decoded and scaled images
+    int memorycachesize; // KiB of downloaded media data
+    int diskcachesize;   // KiB of downloaded media data on disk, 0 disables
+    int downloadjobs;    // concurrent media downloads
+    int downloadhostjobs;
     bool usearts : 1;
     bool no_intro : 1;
     bool sizeratio : 1;
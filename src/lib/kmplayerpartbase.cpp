@@ -258,6 +258,13 @@ QString PartBase::doEvaluate (const QString &) {
 }
 
 void PartBase::settingsChanged () {
+    m_media_manager->setPrefetchBudget (m_settings->prefetchbudget,
+            m_settings->prefetchjobs);
+    m_media_manager->setImageCacheBudget (m_settings->imagecachesize);
+    m_media_manager->setMemoryCacheBudget (m_settings->memorycachesize);
+    m_media_manager->setDiskCacheBudget (m_settings->diskcachesize);
+    m_media_manager->setDownloadLimits (m_settings->downloadjobs,
+            m_settings->downloadhostjobs);
     if (!m_view)
         return;
     if (m_settings->showcnfbutton)
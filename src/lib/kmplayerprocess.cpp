@@ -5,6 +5,7 @@
 */
 
 #include <cmath>
+#include <ctype.h>
 #include "config-kmplayer.h"
 #include <unistd.h>
 #include <QString>
@@ -40,6 +41,7 @@
 #include "kmplayercontrolpanel.h"
 #include "kmplayerprocess.h"
 #include "kmplayerpartbase.h"
+#include "mplayeroutput.h"
 #include "masteradaptor.h"
 #include "streammasteradaptor.h"
 #ifdef KMPLAYER_WITH_NPP
@@ -518,7 +520,7 @@ bool MPlayer::deMediafiedPlay () {
     connect (m_process, &QProcess::readyReadStandardError,
             this, &MPlayer::processOutput);
 
-    m_process_output = QString ();
+    m_process_output = QByteArray ();
     m_source->setPosition (0);
     if (!m_needs_restarted) {
         if (m_source->identified ()) {
@@ -762,17 +764,25 @@ void MPlayer::processOutput () {
     View *v = view ();
 
     bool ok;
-    QRegExp *patterns = static_cast<MPlayerPreferencesPage *>(process_info->config_page)->m_patterns;
+    MPlayerPreferencesPage *page = static_cast<MPlayerPreferencesPage *>(process_info->config_page);
+    QRegExp *patterns = page->m_patterns;
     QRegExp & m_refURLRegExp = patterns[MPlayerPreferencesPage::pat_refurl];
     QRegExp & m_refRegExp = patterns[MPlayerPreferencesPage::pat_ref];
     do {
         int len = strcspn (str, "\r\n");
-        QString out = m_process_output + QString::fromLocal8Bit (str, len);
-        m_process_output = QString ();
+        const char *line = str;
+        int line_len = len;
+        QByteArray joined; // only when the line started in a previous read
+        if (!m_process_output.isEmpty ()) {
+            joined = m_process_output + QByteArray (str, len);
+            m_process_output = QByteArray ();
+            line = joined.constData ();
+            line_len = joined.size ();
+        }
         str += len;
         slen -= len;
         if (slen <= 0) {
-            m_process_output = out;
+            m_process_output = QByteArray (line, line_len);
             break;
         }
         bool process_stats = false;
@@ -785,116 +795,137 @@ void MPlayer::processOutput () {
         }
         str++;
         slen--;
+        const char *line_end = line + line_len;
 
         if (process_stats) {
-            QRegExp & m_posRegExp = patterns[MPlayerPreferencesPage::pat_pos];
-            QRegExp & m_cacheRegExp = patterns[MPlayerPreferencesPage::pat_cache];
-            if (m_posRegExp.indexIn (out) > -1) {
+            // status lines come many times a second, skip the QRegExp's
+            // unless the user changed the patterns
+            double pos = 0.0;
+            double fill = 0.0;
+            bool has_pos = false;
+            bool has_fill = false;
+            if (page->default_status_patterns) {
+                has_pos = statusPosition (line, line_len, pos);
+                has_fill = !has_pos && statusCacheFill (line, line_len, fill);
+            } else {
+                const QString out = QString::fromLocal8Bit (line, line_len);
+                QRegExp & m_posRegExp = patterns[MPlayerPreferencesPage::pat_pos];
+                QRegExp & m_cacheRegExp = patterns[MPlayerPreferencesPage::pat_cache];
+                if (m_posRegExp.indexIn (out) > -1) {
+                    has_pos = true;
+                    pos = m_posRegExp.cap (1).toFloat ();
+                } else if (m_cacheRegExp.indexIn (out) > -1) {
+                    has_fill = true;
+                    fill = m_cacheRegExp.cap (1).toDouble ();
+                }
+            }
+            if (has_pos) {
                 if (m_source->hasLength ()) {
-                    int pos = int (10.0 * m_posRegExp.cap (1).toFloat ());
-                    m_source->setPosition (pos);
+                    m_source->setPosition (int (10.0 * pos));
                     m_request_seek = -1;
                 }
                 if (Playing == m_transition_state) {
                     m_transition_state = NotRunning;
                     setState (Playing);
                 }
-            } else if (m_cacheRegExp.indexIn (out) > -1) {
-                m_source->setLoading (int (m_cacheRegExp.cap(1).toDouble()));
+            } else if (has_fill) {
+                m_source->setLoading (int (fill));
             }
-        } else if (out.startsWith ("ID_LENGTH")) {
-            int pos = out.indexOf ('=');
-            if (pos > 0) {
-                int l = (int) out.mid (pos + 1).toDouble (&ok);
-                if (ok && l >= 0) {
-                    m_source->setLength (mrl (), 10 * l);
-                }
-            }
-        } else if (out.startsWith ("ID_PAUSED")) {
-            if (Paused == m_transition_state) {
-                m_transition_state = NotRunning;
-                setState (Paused);
-            }
-        } else if (m_refURLRegExp.indexIn(out) > -1) {
-            qCDebug(LOG_KMPLAYER_COMMON) << "Reference mrl " << m_refURLRegExp.cap (1);
-            if (!m_tmpURL.isEmpty () &&
-                    (m_url.endsWith (m_tmpURL) || m_tmpURL.endsWith (m_url)))
-                m_source->insertURL (mrl (), m_tmpURL);;
-            const QUrl tmp = QUrl::fromUserInput(m_refURLRegExp.cap (1));
-            m_tmpURL = tmp.isLocalFile () ? tmp.toLocalFile () : tmp.url ();
-            if (m_source->url () == tmp ||
-                    m_url.endsWith (m_tmpURL) || m_tmpURL.endsWith (m_url))
-                m_tmpURL.truncate (0);
-        } else if (m_refRegExp.indexIn (out) > -1) {
-            qCDebug(LOG_KMPLAYER_COMMON) << "Reference File ";
-            m_tmpURL.truncate (0);
-        } else if (out.startsWith ("ID_VIDEO_WIDTH")) {
-            int pos = out.indexOf ('=');
-            if (pos > 0) {
-                int w = out.mid (pos + 1).toInt ();
-                m_source->setDimensions (mrl (), w, m_source->height ());
-            }
-        } else if (out.startsWith ("ID_VIDEO_HEIGHT")) {
-            int pos = out.indexOf ('=');
-            if (pos > 0) {
-                int h = out.mid (pos + 1).toInt ();
-                m_source->setDimensions (mrl (), m_source->width (), h);
+            continue;
+        }
+
+        MPlayerLine kind;
+        const char *value;
+        if (mplayerLine (line, line_len, kind, value)) {
+            switch (kind) {
+            case LineLength: {
+                double l;
+                if (value && parseNumber (value, line_end, l) && l >= 0)
+                    m_source->setLength (mrl (), 10 * (int) l);
+                break;
             }
-        } else if (out.startsWith ("ID_VIDEO_ASPECT")) {
-            int pos = out.indexOf ('=');
-            if (pos > 0) {
-                bool ok;
-                QString val = out.mid (pos + 1);
-                float a = val.toFloat (&ok);
-                if (!ok) {
-                    val.replace (',', '.');
-                    a = val.toFloat (&ok);
+            case LinePaused:
+                if (Paused == m_transition_state) {
+                    m_transition_state = NotRunning;
+                    setState (Paused);
                 }
-                if (ok && a > 0.001)
+                break;
+            case LineVideoWidth:
+                if (value)
+                    m_source->setDimensions (mrl (),
+                            parseInt (value, line_end), m_source->height ());
+                break;
+            case LineVideoHeight:
+                if (value)
+                    m_source->setDimensions (mrl (),
+                            m_source->width (), parseInt (value, line_end));
+                break;
+            case LineVideoAspect: {
+                double a;
+                if (value && parseNumber (value, line_end, a, true) && a > 0.001)
                     m_source->setAspect (mrl (), a);
+                break;
             }
-        } else if (out.startsWith ("ID_AID_")) {
-            int pos = out.indexOf ('_', 7);
-            if (pos > 0) {
-                int id = out.mid (7, pos - 7).toInt ();
-                pos = out.indexOf ('=', pos);
-                if (pos > 0) {
+            case LineAudioLang:
+            case LineSubtitleLang: {
+                const char *sep = (const char *) memchr (line + 7, '_', line_len - 7);
+                if (!sep || !value || value < sep)
+                    break;
+                int id = parseInt (line + 7, sep);
+                Source::LangInfo *info = new Source::LangInfo (id,
+                        QString::fromLocal8Bit (value, line_end - value));
+                if (LineAudioLang == kind) {
                     if (!alanglist_end) {
-                        alanglist = new Source::LangInfo (id, out.mid (pos + 1));
+                        alanglist = info;
                         alanglist_end = alanglist;
                     } else {
-                        alanglist_end->next = new Source::LangInfo (id, out.mid(pos+1));
+                        alanglist_end->next = info;
                         alanglist_end = alanglist_end->next;
                     }
                     qCDebug(LOG_KMPLAYER_COMMON) << "lang " << id << " " << alanglist_end->name;
-                }
-            }
-        } else if (out.startsWith ("ID_SID_")) {
-            int pos = out.indexOf ('_', 7);
-            if (pos > 0) {
-                int id = out.mid (7, pos - 7).toInt ();
-                pos = out.indexOf ('=', pos);
-                if (pos > 0) {
+                } else {
                     if (!slanglist_end) {
-                        slanglist = new Source::LangInfo (id, out.mid (pos + 1));
+                        slanglist = info;
                         slanglist_end = slanglist;
                     } else {
-                        slanglist_end->next = new Source::LangInfo (id, out.mid(pos+1));
+                        slanglist_end->next = info;
                         slanglist_end = slanglist_end->next;
                     }
                     qCDebug(LOG_KMPLAYER_COMMON) << "sid " << id << " " << slanglist_end->name;
                 }
+                break;
             }
-        } else if (out.startsWith ("ICY Info")) {
-            int p = out.indexOf ("StreamTitle=", 8);
-            if (p > -1) {
-                p += 12;
-                int e = out.indexOf (';', p);
-                if (e > -1)
-                    e -= p;
-                QString inf = out.mid (p, e);
-                mrl ()->document ()->message (MsgInfoString, &inf);
+            case LineIcyInfo: {
+                const QByteArray icy = QByteArray::fromRawData (line, line_len);
+                int p = icy.indexOf ("StreamTitle=", 8);
+                if (p > -1) {
+                    p += 12;
+                    int e = icy.indexOf (';', p);
+                    if (e < 0)
+                        e = line_len;
+                    QString inf = QString::fromLocal8Bit (line + p, e - p);
+                    mrl ()->document ()->message (MsgInfoString, &inf);
+                }
+                break;
             }
+            }
+            continue;
+        }
+
+        const QString out = QString::fromLocal8Bit (line, line_len);
+        if (m_refURLRegExp.indexIn(out) > -1) {
+            qCDebug(LOG_KMPLAYER_COMMON) << "Reference mrl " << m_refURLRegExp.cap (1);
+            if (!m_tmpURL.isEmpty () &&
+                    (m_url.endsWith (m_tmpURL) || m_tmpURL.endsWith (m_url)))
+                m_source->insertURL (mrl (), m_tmpURL);;
+            const QUrl tmp = QUrl::fromUserInput(m_refURLRegExp.cap (1));
+            m_tmpURL = tmp.isLocalFile () ? tmp.toLocalFile () : tmp.url ();
+            if (m_source->url () == tmp ||
+                    m_url.endsWith (m_tmpURL) || m_tmpURL.endsWith (m_url))
+                m_tmpURL.truncate (0);
+        } else if (m_refRegExp.indexIn (out) > -1) {
+            qCDebug(LOG_KMPLAYER_COMMON) << "Reference File ";
+            m_tmpURL.truncate (0);
         } else if (v) {
             QRegExp & m_startRegExp = patterns[MPlayerPreferencesPage::pat_start];
             QRegExp & m_sizeRegExp = patterns[MPlayerPreferencesPage::pat_size];
@@ -1044,7 +1075,13 @@ MPlayerPreferencesFrame::MPlayerPreferencesFrame (QWidget * parent)
 }
 
 MPlayerPreferencesPage::MPlayerPreferencesPage ()
- : m_configframe (nullptr) {
+ : default_status_patterns (false), m_configframe (nullptr) {
+}
+
+void MPlayerPreferencesPage::updatePatterns () {
+    default_status_patterns =
+        m_patterns[pat_pos].pattern () == _mplayer_patterns[pat_pos].pattern &&
+        m_patterns[pat_cache].pattern () == _mplayer_patterns[pat_cache].pattern;
 }
 
 void MPlayerPreferencesPage::write (KSharedConfigPtr config) {
@@ -1064,6 +1101,7 @@ void MPlayerPreferencesPage::read (KSharedConfigPtr config) {
     for (int i = 0; i < int (pat_last); i++)
         m_patterns[i].setPattern (patterns_cfg.readEntry
                 (_mplayer_patterns[i].name, _mplayer_patterns[i].pattern));
+    updatePatterns ();
     KConfigGroup mplayer_cfg (config, strMPlayerGroup);
     mplayer_path = mplayer_cfg.readEntry (strMPlayerPath, QString ("mplayer"));
     additionalarguments = mplayer_cfg.readEntry (strAddArgs, QString ());
@@ -1080,6 +1118,7 @@ void MPlayerPreferencesPage::sync (bool fromUI) {
         additionalarguments = table->item (1, 1)->text ();
         for (int i = 0; i < int (pat_last); i++)
             m_patterns[i].setPattern (table->item (i+non_patterns, 1)->text ());
+        updatePatterns ();
         cachesize = cacheSize->value();
         alwaysbuildindex = buildIndex->isChecked ();
     } else {
@@ -1728,12 +1767,10 @@ void NpStream::open () {
         if (!result.isEmpty ()) {
             QByteArray cr = result.toLocal8Bit ();
             int len = strlen (cr.constData ());
-            pending_buf.resize (len + 1);
-            memcpy (pending_buf.data (), cr.constData (), len);
-            pending_buf.data ()[len] = 0;
+            pending_buf.append (QByteArray (cr.constData (), len + 1));
             gettimeofday (&data_arrival, nullptr);
         }
-        qCDebug(LOG_KMPLAYER_COMMON) << "result is " << pending_buf.constData ();
+        qCDebug(LOG_KMPLAYER_COMMON) << "result is " << result;
         finish_reason = BecauseDone;
         Q_EMIT stateChanged ();
     } else {
@@ -1816,12 +1853,7 @@ void NpStream::slotResult (KJob *jb) {
 void NpStream::slotData (KIO::Job*, const QByteArray& qb) {
     if (job) {
         int sz = pending_buf.size ();
-        if (sz) {
-            pending_buf.resize (sz + qb.size ());
-            memcpy (pending_buf.data () + sz, qb.constData (), qb.size ());
-        } else {
-            pending_buf = qb;
-        }
+        pending_buf.append (qb);
         if (sz + qb.size () > 64000 &&
                 !job->isSuspended () && !job->suspend ())
             qCCritical(LOG_KMPLAYER_COMMON) << "suspend not supported" << endl;
@@ -2232,18 +2264,17 @@ void NpPlayer::processStreams () {
             msg.setDelayedReply (false);
             QDBusConnection::sessionBus().send (msg);
         }
-        const int header_len = 2 * sizeof (qint32);
+        qint32 header [2];
         qint32 chunk = stream->pending_buf.size ();
-        send_buf.resize (chunk + header_len);
-        memcpy (send_buf.data (), &stream_id, sizeof (qint32));
-        memcpy (send_buf.data() + sizeof (qint32), &chunk, sizeof (qint32));
-        memcpy (send_buf.data ()+header_len,
-                stream->pending_buf.constData (), chunk);
-        stream->pending_buf = QByteArray ();
+        header [0] = stream_id;
+        header [1] = chunk;
         /*fprintf (stderr, " => %d %d\n", (long)stream_id, chunk);*/
         stream->bytes += chunk;
         write_in_progress = true;
-        m_process->write (send_buf);
+        // the received chunks go to the pipe as they are, no joining copy
+        m_process->write ((const char *) header, sizeof (header));
+        stream->pending_buf.writeTo (m_process);
+        stream->pending_buf.clear ();
         if (stream->finish_reason == NpStream::NoReason)
             stream->job->resume ();
     }
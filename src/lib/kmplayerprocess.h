@@ -166,7 +166,7 @@ protected:
 private Q_SLOTS:
     void processOutput () KMPLAYERCOMMON_NO_EXPORT;
 private:
-    QString m_process_output;
+    QByteArray m_process_output; // incomplete last line
     QString m_grab_file;
     QString m_grab_dir;
     QWidget * m_widget;
@@ -201,11 +201,13 @@ public:
     void prefLocation (QString & item, QString & icon, QString & tab) override;
     QFrame * prefPage (QWidget * parent) override;
     QRegExp m_patterns[pat_last];
+    bool default_status_patterns; // status lines are parsed without QRegExp
     int cachesize;
     QString mplayer_path;
     QString additionalarguments;
     bool alwaysbuildindex;
 private:
+    void updatePatterns ();
     MPlayer * m_process;
     MPlayerPreferencesFrame *m_configframe;
 };
@@ -424,7 +426,7 @@ public:
 
     QString url;
     QByteArray post;
-    QByteArray pending_buf;
+    ChunkBuffer pending_buf;
     KIO::TransferJob *job;
     timeval data_arrival;
     uint32_t bytes;
@@ -508,7 +510,6 @@ private:
     StreamMap streams;
     QString remote_service;
     QString m_base_url;
-    QByteArray send_buf;
     bool write_in_progress;
     bool in_process_stream;
 };
@@ -52,6 +52,9 @@
 
 using namespace KMPlayer;
 
+static const int max_log_lines = 1000;
+static const int log_flush_interval = 100; // ms
+
 //-------------------------------------------------------------------------
 
 PictureWidget::PictureWidget (QWidget * parent, View * view)
@@ -100,6 +103,10 @@ void InfoWindow::contextMenuEvent (QContextMenuEvent * e) {
 
 View::View (QWidget *parent)
   : KMediaPlayer::View (parent),
+    log_lines (max_log_lines),
+    log_first (0),
+    log_count (0),
+    log_pending (0),
     m_control_panel (nullptr),
     m_status_bar (nullptr),
     m_controlpanel_mode (CP_Show),
@@ -108,13 +115,13 @@ View::View (QWidget *parent)
     controlbar_timer (0),
     infopanel_timer (0),
     m_restore_state_timer(0),
+    log_timer (0),
     m_powerManagerStopSleep( -1 ),
     m_inhibitIface("org.freedesktop.PowerManagement.Inhibit",
                    "/org/freedesktop/PowerManagement/Inhibit",
                    QDBusConnection::sessionBus()),
     m_keepsizeratio (false),
     m_playing (false),
-    m_tmplog_needs_eol (false),
     m_revert_fullscreen (false),
     m_no_info (false),
     m_edit_mode (false)
@@ -327,7 +334,7 @@ void View::toggleVideoConsoleWindow () {
         m_multiedit->show ();
         m_multiedit->raise ();
         m_view_area->setVideoWidgetVisible (false);
-        addText (QString (""), false);
+        flushLog ();
         if (m_controlpanel_mode == CP_AutoHide && m_playing)
             m_control_panel->show();
     }
@@ -436,31 +443,62 @@ void View::timerEvent (QTimerEvent * e) {
         setControlPanelMode (m_old_controlpanel_mode);
         m_dockarea->restoreState(m_dock_state);
         m_restore_state_timer = 0;
+    } else if (e->timerId () == log_timer) {
+        log_timer = 0;
+        flushLog ();
     }
     killTimer (e->timerId ());
 }
 
+/*
+ * Console output is kept as a ring of lines. Only while the console is
+ * shown, the new lines are appended to it, at most ten times a second.
+ */
 void View::addText (const QString & str, bool eol) {
-    if (m_tmplog_needs_eol)
-        tmplog += QChar ('\n');
-    tmplog += str;
-    m_tmplog_needs_eol = eol;
-    if (!m_multiedit->isVisible () && tmplog.size () < 7500)
-        return;
-    if (eol) {
-        if (m_multiedit->document ()->isEmpty ())
-            m_multiedit->setPlainText (tmplog);
-        else
-            m_multiedit->append (tmplog);
-        tmplog.truncate (0);
-        m_tmplog_needs_eol = false;
+    int pos = str.indexOf (QChar ('\n'));
+    if (pos < 0) {
+        log_partial += str;
     } else {
-        int pos = tmplog.lastIndexOf (QChar ('\n'));
-        if (pos >= 0) {
-            m_multiedit->append (tmplog.left (pos));
-            tmplog = tmplog.mid (pos+1);
+        int start = 0;
+        for (; pos >= 0; pos = str.indexOf (QChar ('\n'), start)) {
+            addLogLine (log_partial + str.mid (start, pos - start));
+            log_partial.truncate (0);
+            start = pos + 1;
         }
+        log_partial = str.mid (start);
+    }
+    if (eol) {
+        addLogLine (log_partial);
+        log_partial.truncate (0);
     }
+    if (log_pending && !log_timer && m_multiedit->isVisible ())
+        log_timer = startTimer (log_flush_interval);
+}
+
+void View::addLogLine (const QString &line) {
+    log_lines [(log_first + log_count) % max_log_lines] = line;
+    if (log_count < max_log_lines)
+        ++log_count;
+    else
+        log_first = (log_first + 1) % max_log_lines;
+    if (log_pending < max_log_lines)
+        ++log_pending;
+}
+
+void View::flushLog () {
+    if (!log_pending)
+        return;
+    QString text;
+    for (int i = log_count - log_pending; i < log_count; ++i) {
+        if (i > log_count - log_pending)
+            text += QChar ('\n');
+        text += log_lines [(log_first + i) % max_log_lines];
+    }
+    log_pending = 0;
+    if (m_multiedit->document ()->isEmpty ())
+        m_multiedit->setPlainText (text);
+    else
+        m_multiedit->append (text);
     QTextCursor cursor = m_multiedit->textCursor ();
     cursor.movePosition (QTextCursor::End);
     cursor.movePosition (QTextCursor::PreviousBlock, QTextCursor::MoveAnchor, 5000);
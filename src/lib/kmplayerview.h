@@ -12,6 +12,7 @@
 #include <QTextEdit>
 #include <QImage>
 #include <QList>
+#include <QVector>
 #include <QUrl>
 
 #include <KMediaPlayer/View>
@@ -151,6 +152,9 @@ protected:
     void leaveEvent (QEvent *) override KMPLAYERCOMMON_NO_EXPORT;
     void timerEvent(QTimerEvent*) override KMPLAYERCOMMON_NO_EXPORT;
 private:
+    void addLogLine (const QString &line) KMPLAYERCOMMON_NO_EXPORT;
+    void flushLog () KMPLAYERCOMMON_NO_EXPORT;
+
     QByteArray m_dock_state;
     // console output
     TextEdit * m_multiedit;
@@ -164,7 +168,12 @@ private:
     QMainWindow *m_dockarea;
     QDockWidget *m_dock_playlist;
     QDockWidget *m_dock_infopanel;
-    QString tmplog;
+    // last lines of console output, the newest log_pending not shown yet
+    QVector <QString> log_lines;
+    int log_first;
+    int log_count;
+    int log_pending;
+    QString log_partial;
     QImage m_image;
     ControlPanel * m_control_panel;
     StatusBar * m_status_bar;
@@ -174,12 +183,12 @@ private:
     int controlbar_timer;
     int infopanel_timer;
     int m_restore_state_timer;
+    int log_timer;
     int m_powerManagerStopSleep;
     OrgFreedesktopPowerManagementInhibitInterface m_inhibitIface;
     bool m_keepsizeratio;
     bool m_playing;
     bool m_sreensaver_disabled;
-    bool m_tmplog_needs_eol;
     bool m_revert_fullscreen;
     bool m_no_info;
     bool m_edit_mode;
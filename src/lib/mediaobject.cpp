@@ -5,9 +5,10 @@
     SPDX-License-Identifier: LGPL-2.0-or-later
 */
 
+#include <ctype.h>
+
 #include <QTextStream>
 #include <QApplication>
-#include <QMovie>
 #include <QBuffer>
 #include <QPainter>
 #include <QSvgRenderer>
@@ -18,6 +19,24 @@
 #include <QTextStream>
 #include <QMimeDatabase>
 #include <QMimeType>
+#include <QStandardPaths>
+#include <QDir>
+#include <QSaveFile>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QLocale>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTimer>
+#include <QImageReader>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QThread>
+#include <QMutex>
+#include <QElapsedTimer>
+#include <QQueue>
+#include <QEvent>
+#include <QtMath>
 
 #include <KLocalizedString>
 #include <KIO/Job>
@@ -29,6 +48,7 @@
 #include "expression.h"
 #include "viewarea.h"
 #include "kmplayerpartbase.h"
+#include "mimesniff.h"
 #include "kmplayercommon_log.h"
 
 using namespace KMPlayer;
@@ -36,15 +56,218 @@ using namespace KMPlayer;
 namespace {
 
     typedef QMap <QString, ImageDataPtrW> ImageDataMap;
+    typedef QMap <QString, AnimatedImagePtrW> AnimatedImageMap;
+
+    /*
+     * Decodes images on a small pool of worker threads. Results are posted
+     * back to the GUI thread, where a cancelled request is simply dropped.
+     */
+    class ImageDecoder : public QObject {
+    public:
+        ImageDecoder ();
+        ~ImageDecoder () override;
+
+        int decode (ImageMedia *media, const QString &url, const QByteArray &ba);
+        int decodeFile (ImageMedia *media, const QString &url,
+                const QString &path);
+        int render (ImageMedia *media, const QByteArray &xml, const QSize &size);
+        void start (QRunnable *job) { pool.start (job); }
+        void cancel (int id);
+        bool pending (int id);
+
+    protected:
+        void customEvent (QEvent *event) override;
+
+    private:
+        int request (ImageMedia *media);
+
+        QThreadPool pool;
+        QMutex mutex;
+        QMap <int, ImageMedia *> requests;
+        int last_id;
+    };
+
+    static const QEvent::Type image_decoded_event =
+        (QEvent::Type) QEvent::registerEventType ();
+
+    class ImageDecodedEvent : public QEvent {
+    public:
+        ImageDecodedEvent (int i, const QString &u, const QImage &img, bool a,
+                bool s=false, const QByteArray &d=QByteArray ())
+         : QEvent (image_decoded_event), id (i), url (u), image (img),
+           animated (a), svg (s), data (d) {}
+        int id;
+        QString url;
+        QImage image;
+        bool animated;
+        bool svg;
+        QByteArray data; // file contents, for the frames of an animation
+    };
+
+    class ImageDecodeJob : public QRunnable {
+    public:
+        ImageDecodeJob (ImageDecoder *d, int i, const QString &u,
+                const QByteArray &ba, const QString &p=QString ())
+         : decoder (d), id (i), url (u), data (ba), path (p) {}
+        void run () override;
+    private:
+        ImageDecoder *decoder;
+        int id;
+        QString url;
+        QByteArray data;
+        QString path;   // local file, decoded from a mapping instead of data
+    };
+
+    class SvgRenderJob : public QRunnable {
+    public:
+        SvgRenderJob (ImageDecoder *d, int i, const QByteArray &x,
+                const QSize &s)
+         : decoder (d), id (i), xml (x), size (s) {}
+        void run () override;
+    private:
+        ImageDecoder *decoder;
+        int id;
+        QByteArray xml;
+        QSize size;
+    };
+
+    void SvgRenderJob::run () {
+        if (!decoder->pending (id))
+            return;
+        QSvgRenderer renderer (xml);
+        QImage img (size, QImage::Format_ARGB32_Premultiplied);
+        img.fill (0x0);
+        if (renderer.isValid ()) {
+            QPainter paint (&img);
+            paint.setViewport (QRect (QPoint (), size));
+            // in bands, so a request cancelled by requestRaster or
+            // cancelDecode stops early
+            for (int y = 0; y < size.height (); y += 128) {
+                if (!decoder->pending (id))
+                    return;
+                paint.setClipRect (0, y, size.width (), 128);
+                renderer.render (&paint);
+            }
+        }
+        QCoreApplication::postEvent (decoder,
+                new ImageDecodedEvent (id, QString (), img, false, true));
+    }
+
+    void ImageDecodeJob::run () {
+        if (!decoder->pending (id))
+            return; // cancelled while queued
+        QFile file (path);
+        if (!path.isEmpty () && file.open (QIODevice::ReadOnly)) {
+            const qint64 size = file.size ();
+            uchar *mapped = size > 0 && size <= 0x7fffffff
+                ? file.map (0, size, QFileDevice::MapPrivateOption)
+                : nullptr;
+            if (mapped)
+                data = QByteArray::fromRawData ((const char *) mapped, size);
+            else
+                data = file.readAll ();
+        }
+        QBuffer buf (&data);
+        QImageReader reader (&buf);
+        QImage img = reader.read ();
+        bool animated = false;
+        if (!img.isNull ()) {
+            img = img.convertToFormat (img.hasAlphaChannel ()
+                    ? QImage::Format_ARGB32_Premultiplied
+                    : QImage::Format_RGB32);
+            animated = reader.supportsAnimation () && reader.imageCount () > 1;
+        }
+        QByteArray frames;
+        if (animated && !path.isEmpty ()) // outlives the mapping
+            frames = QByteArray (data.constData (), data.size ());
+        QCoreApplication::postEvent (decoder,
+                new ImageDecodedEvent (id, url, img, animated, false, frames));
+    }
+
+    ImageDecoder::ImageDecoder () : last_id (0) {
+        pool.setMaxThreadCount (qBound (1, QThread::idealThreadCount () - 1, 4));
+    }
+
+    ImageDecoder::~ImageDecoder () {
+        mutex.lock ();
+        requests.clear ();
+        mutex.unlock ();
+        pool.waitForDone ();
+    }
+
+    int ImageDecoder::request (ImageMedia *media) {
+        QMutexLocker lock (&mutex);
+        int id = ++last_id;
+        if (!id) // wrapped
+            id = ++last_id;
+        requests.insert (id, media);
+        return id;
+    }
+
+    int ImageDecoder::decode (ImageMedia *media, const QString &url,
+            const QByteArray &ba) {
+        int id = request (media);
+        pool.start (new ImageDecodeJob (this, id, url, ba));
+        return id;
+    }
+
+    int ImageDecoder::decodeFile (ImageMedia *media, const QString &url,
+            const QString &path) {
+        int id = request (media);
+        pool.start (new ImageDecodeJob (this, id, url, QByteArray (), path));
+        return id;
+    }
+
+    int ImageDecoder::render (ImageMedia *media, const QByteArray &xml,
+            const QSize &size) {
+        int id = request (media);
+        pool.start (new SvgRenderJob (this, id, xml, size));
+        return id;
+    }
+
+    void ImageDecoder::cancel (int id) {
+        QMutexLocker lock (&mutex);
+        requests.remove (id);
+    }
+
+    bool ImageDecoder::pending (int id) {
+        QMutexLocker lock (&mutex);
+        return requests.contains (id);
+    }
+
+    void ImageDecoder::customEvent (QEvent *event) {
+        if (event->type () != image_decoded_event)
+            return;
+        ImageDecodedEvent *de = static_cast <ImageDecodedEvent *> (event);
+        mutex.lock ();
+        ImageMedia *media = requests.take (de->id);
+        mutex.unlock ();
+        if (media && de->svg)
+            media->svgRendered (de->image);
+        else if (media)
+            media->imageDecoded (de->url, de->image, de->animated, de->data);
+    }
 
     static DataCache *memory_cache;
     static ImageDataMap *image_data_map;
+    static AnimatedImageMap *animated_images;
+    static PrefetchScheduler *prefetch_scheduler;
+    static FetchScheduler *fetch_scheduler;
+    static CrossDomainPolicies *cross_domain_policies;
+    static ImageCache *image_cache;
+    static ImageDecoder *image_decoder;
 
     struct GlobalMediaData : public GlobalShared<GlobalMediaData> {
         GlobalMediaData (GlobalMediaData **gb)
          : GlobalShared<GlobalMediaData> (gb) {
             memory_cache = new DataCache;
             image_data_map = new ImageDataMap;
+            animated_images = new AnimatedImageMap;
+            prefetch_scheduler = new PrefetchScheduler;
+            fetch_scheduler = new FetchScheduler;
+            cross_domain_policies = new CrossDomainPolicies;
+            image_cache = new ImageCache;
+            image_decoder = new ImageDecoder;
         }
         ~GlobalMediaData () override;
     };
@@ -52,8 +275,22 @@ namespace {
     static GlobalMediaData *global_media;
 
     GlobalMediaData::~GlobalMediaData () {
-        delete memory_cache;
+        delete image_decoder;
+        image_decoder = nullptr;
+        delete prefetch_scheduler;
+        prefetch_scheduler = nullptr;
+        delete memory_cache; // its revalidations use fetch_scheduler
+        memory_cache = nullptr;
+        delete fetch_scheduler;
+        fetch_scheduler = nullptr;
+        delete cross_domain_policies;
+        cross_domain_policies = nullptr;
+        delete image_cache; // releases ImageData's, before image_data_map
+        image_cache = nullptr;
         delete image_data_map;
+        image_data_map = nullptr;
+        delete animated_images;
+        animated_images = nullptr;
         global_media = nullptr;
     }
 
@@ -137,6 +374,26 @@ MediaManager::~MediaManager () {
     global_media->unref ();
 }
 
+void MediaManager::setPrefetchBudget (int kbytes, int jobs) {
+    prefetch_scheduler->setBudget (kbytes * 1024, jobs);
+}
+
+void MediaManager::setDownloadLimits (int jobs, int host_jobs) {
+    fetch_scheduler->setLimits (jobs, host_jobs);
+}
+
+void MediaManager::setImageCacheBudget (int kbytes) {
+    image_cache->setBudget (kbytes);
+}
+
+void MediaManager::setMemoryCacheBudget (int kbytes) {
+    memory_cache->setBudget (kbytes);
+}
+
+void MediaManager::setDiskCacheBudget (int kbytes) {
+    memory_cache->setDiskBudget (kbytes);
+}
+
 MediaObject *MediaManager::createAVMedia (Node *node, const QByteArray &) {
     RecordDocument *rec = id_node_record_document == node->id
         ? convertNode <RecordDocument> (node)
@@ -297,44 +554,520 @@ Mrl *MediaObject::mrl () {
 
 //------------------------%<----------------------------------------------------
 
-void DataCache::add (const QString & url, const QString &mime, const QByteArray & data) {
-    QByteArray bytes;
-    bytes = data;
-    cache_map.insert (url, qMakePair (mime, bytes));
-    preserve_map.remove (url);
-    Q_EMIT preserveRemoved (url);
+static QString httpHeader (const QString &headers, const QString &name) {
+    const QStringList lines = headers.split (QChar ('\n'));
+    for (const QString &line : lines) {
+        int colon = line.indexOf (QChar (':'));
+        if (colon > 0 &&
+                !line.left (colon).trimmed ().compare (name, Qt::CaseInsensitive))
+            return line.mid (colon + 1).trimmed ();
+    }
+    return QString ();
+}
+
+static bool isPlayListMime (const QString & mime);
+
+/*
+ * Seconds since epoch until which a response may be used without asking
+ * the server again, 0 if the headers don't say, -1 if never
+ */
+static qint64 freshUntil (const QString &headers) {
+    const QString cc = httpHeader (headers, "Cache-Control").toLower ();
+    if (cc.contains ("no-cache") || cc.contains ("no-store"))
+        return -1;
+    const qint64 now = QDateTime::currentSecsSinceEpoch ();
+    int pos = cc.indexOf ("max-age=");
+    if (pos > -1) {
+        bool ok;
+        qint64 age = cc.mid (pos + 8).section (QChar (','), 0, 0)
+            .trimmed ().toLongLong (&ok);
+        return ok && age > 0 ? now + age : -1;
+    }
+    const QString expires = httpHeader (headers, "Expires");
+    if (!expires.isEmpty ()) {
+        QDateTime date = QLocale::c ().toDateTime (expires,
+                "ddd, dd MMM yyyy HH:mm:ss 'GMT'");
+        date.setTimeSpec (Qt::UTC);
+        // an unparsable date, like "0", means already expired
+        return date.isValid () && date.toSecsSinceEpoch () > now
+            ? date.toSecsSinceEpoch () : -1;
+    }
+    return 0;
+}
+
+/* Without an expiry anything but playlists and feeds is considered fresh */
+static bool isFresh (qint64 expires, const QString &mime) {
+    if (!expires)
+        return !isPlayListMime (mime);
+    return expires > QDateTime::currentSecsSinceEpoch ();
+}
+
+static bool mayStore (const QString &headers) {
+    const QString cc = httpHeader (headers, "Cache-Control").toLower ();
+    return !cc.contains ("no-store") && !cc.contains ("private");
+}
+
+DiskCache::DiskCache (QObject *parent)
+ : QObject (parent),
+   path (QStandardPaths::writableLocation (QStandardPaths::GenericCacheLocation)
+           + "/kmplayer/media/"),
+   budget (256 * 1024 * 1024), bytes (0), loaded (false), save_pending (false) {}
+
+DiskCache::~DiskCache () {
+    if (fetch_scheduler)
+        fetch_scheduler->cancel (this);
+    const QMap <KJob *, Revalidation>::iterator e = revalidations.end ();
+    for (QMap <KJob *, Revalidation>::iterator i = revalidations.begin (); i != e; ++i) {
+        if (fetch_scheduler)
+            fetch_scheduler->finished (i.key ());
+        i.key ()->kill ();
+    }
+    if (save_pending)
+        saveIndex ();
+}
+
+bool DiskCache::cacheable (const QString &url) {
+    return url.startsWith ("http://") || url.startsWith ("https://");
+}
+
+void DiskCache::setBudget (int kbytes) {
+    budget = qMax (0, kbytes) * Q_INT64_C (1024);
+    if (loaded)
+        evict ();
+}
+
+void DiskCache::load () {
+    loaded = true;
+    QFile file (path + "index.json");
+    if (!file.open (QIODevice::ReadOnly))
+        return;
+    const QJsonObject index = QJsonDocument::fromJson (file.readAll ()).object ();
+    for (QJsonObject::const_iterator i = index.begin (); i != index.end (); ++i) {
+        const QJsonObject o = i.value ().toObject ();
+        Entry entry;
+        entry.hash = o.value ("hash").toString ();
+        entry.mime = o.value ("mime").toString ();
+        entry.etag = o.value ("etag").toString ();
+        entry.last_modified = o.value ("last-modified").toString ();
+        entry.size = (qint64) o.value ("size").toDouble ();
+        entry.used = (qint64) o.value ("used").toDouble ();
+        entry.expires = (qint64) o.value ("expires").toDouble ();
+        if (entry.hash.isEmpty ())
+            continue;
+        entries.insert (i.key (), entry);
+        bytes += entry.size;
+    }
+    evict ();
+}
+
+void DiskCache::saveIndex () {
+    save_pending = false;
+    QJsonObject index;
+    const EntryMap::const_iterator e = entries.constEnd ();
+    for (EntryMap::const_iterator i = entries.constBegin (); i != e; ++i) {
+        QJsonObject o;
+        o.insert ("hash", i.value ().hash);
+        o.insert ("mime", i.value ().mime);
+        if (!i.value ().etag.isEmpty ())
+            o.insert ("etag", i.value ().etag);
+        if (!i.value ().last_modified.isEmpty ())
+            o.insert ("last-modified", i.value ().last_modified);
+        o.insert ("size", (double) i.value ().size);
+        o.insert ("used", (double) i.value ().used);
+        if (i.value ().expires)
+            o.insert ("expires", (double) i.value ().expires);
+        index.insert (i.key (), o);
+    }
+    QSaveFile file (path + "index.json");
+    if (!QDir ().mkpath (path) || !file.open (QIODevice::WriteOnly)) {
+        qCWarning(LOG_KMPLAYER_COMMON) << "DiskCache can't write" << file.fileName ();
+        return;
+    }
+    file.write (QJsonDocument (index).toJson (QJsonDocument::Compact));
+    file.commit ();
+}
+
+void DiskCache::scheduleSave () {
+    if (!save_pending) {
+        save_pending = true;
+        QTimer::singleShot (2000, this, &DiskCache::saveIndex);
+    }
+}
+
+bool DiskCache::get (const QString &url, QString &mime, QByteArray &data,
+        qint64 &expires, bool allow_stale) {
+    if (!budget || !cacheable (url))
+        return false;
+    if (!loaded)
+        load ();
+    EntryMap::iterator it = entries.find (url);
+    if (it == entries.end () ||
+            (!allow_stale && !isFresh (it.value ().expires, it.value ().mime)))
+        return false;
+    QFile file (path + it.value ().hash);
+    if (!file.open (QIODevice::ReadOnly) || file.size () != it.value ().size) {
+        remove (it);
+        scheduleSave ();
+        return false;
+    }
+    data = file.readAll ();
+    mime = it.value ().mime;
+    expires = it.value ().expires;
+    it.value ().used = QDateTime::currentSecsSinceEpoch ();
+    scheduleSave ();
+    return true;
+}
+
+void DiskCache::store (const QString &url, const QString &mime,
+        const QByteArray &data, const QString &http_headers) {
+    if (!budget || !cacheable (url))
+        return;
+    if (!loaded)
+        load ();
+    if (!mayStore (http_headers)) {
+        EntryMap::iterator it = entries.find (url);
+        if (it != entries.end ()) {
+            remove (it);
+            scheduleSave ();
+        }
+        return;
+    }
+    if (data.isEmpty () || data.size () > budget)
+        return;
+    const QString hash = QString::fromLatin1 (
+            QCryptographicHash::hash (data, QCryptographicHash::Sha1).toHex ());
+    if (!QFile::exists (path + hash)) {
+        QSaveFile file (path + hash);
+        if (!QDir ().mkpath (path) || !file.open (QIODevice::WriteOnly) ||
+                file.write (data) != data.size () || !file.commit ()) {
+            qCWarning(LOG_KMPLAYER_COMMON) << "DiskCache can't write" << file.fileName ();
+            return;
+        }
+    }
+    EntryMap::iterator it = entries.find (url);
+    if (it != entries.end ())
+        remove (it);
+    Entry entry;
+    entry.hash = hash;
+    entry.mime = mime;
+    entry.etag = httpHeader (http_headers, "ETag");
+    entry.last_modified = httpHeader (http_headers, "Last-Modified");
+    entry.size = data.size ();
+    entry.used = QDateTime::currentSecsSinceEpoch ();
+    entry.expires = freshUntil (http_headers);
+    entries.insert (url, entry);
+    bytes += entry.size;
+    evict ();
+    scheduleSave ();
+}
+
+void DiskCache::remove (EntryMap::iterator it) {
+    const QString hash = it.value ().hash;
+    bytes -= it.value ().size;
+    entries.erase (it);
+    const EntryMap::const_iterator e = entries.constEnd ();
+    for (EntryMap::const_iterator i = entries.constBegin (); i != e; ++i)
+        if (i.value ().hash == hash)
+            return; // same content for another url
+    QFile::remove (path + hash);
+}
+
+void DiskCache::evict () {
+    while (bytes > budget && !entries.isEmpty ()) {
+        EntryMap::iterator lru = entries.begin ();
+        const EntryMap::iterator e = entries.end ();
+        for (EntryMap::iterator it = entries.begin (); it != e; ++it)
+            if (it.value ().used < lru.value ().used)
+                lru = it;
+        remove (lru);
+        scheduleSave ();
+    }
+}
+
+void DiskCache::revalidate (const QString &url) {
+    if (!entries.contains (url) || revalidations_queued.contains (url) ||
+            !fetch_scheduler)
+        return;
+    const QMap <KJob *, Revalidation>::const_iterator e = revalidations.constEnd ();
+    for (QMap <KJob *, Revalidation>::const_iterator i = revalidations.constBegin (); i != e; ++i)
+        if (i.value ().url == url)
+            return;
+    revalidations_queued.append (url);
+    fetch_scheduler->revalidate (this, QUrl (url));
+}
+
+/* Called by the FetchScheduler, nullptr if the entry is gone meanwhile */
+KJob *DiskCache::startRevalidation (const QUrl &kurl) {
+    QString url;
+    for (int i = 0; i < revalidations_queued.size (); ++i)
+        if (QUrl (revalidations_queued[i]) == kurl) {
+            url = revalidations_queued.takeAt (i);
+            break;
+        }
+    EntryMap::const_iterator it = entries.constFind (url);
+    if (it == entries.constEnd ())
+        return nullptr;
+    QString conditions;
+    if (!it.value ().etag.isEmpty ())
+        conditions += QString ("If-None-Match: %1").arg (it.value ().etag);
+    if (!it.value ().last_modified.isEmpty ()) {
+        if (!conditions.isEmpty ())
+            conditions += QString ("\r\n");
+        conditions += QString ("If-Modified-Since: %1").arg (it.value ().last_modified);
+    }
+    KIO::TransferJob *job = KIO::get (kurl, KIO::Reload, KIO::HideProgressInfo);
+    job->addMetaData ("PropagateHttpHeader", "true");
+    job->addMetaData ("errorPage", "false");
+    if (!conditions.isEmpty ())
+        job->addMetaData ("customHTTPHeader", conditions);
+    Revalidation reval;
+    reval.url = url;
+    revalidations.insert (job, reval);
+    connect (job, &KIO::TransferJob::data, this, &DiskCache::revalidateData);
+    connect (job, &KJob::result, this, &DiskCache::revalidateResult);
+    return job;
+}
+
+void DiskCache::revalidateData (KIO::Job *job, const QByteArray &qb) {
+    QMap <KJob *, Revalidation>::iterator it = revalidations.find (job);
+    if (it != revalidations.end ())
+        it.value ().data += qb;
+}
+
+void DiskCache::revalidateResult (KJob *kjob) {
+    QMap <KJob *, Revalidation>::iterator it = revalidations.find (kjob);
+    if (it == revalidations.end ())
+        return;
+    if (fetch_scheduler)
+        fetch_scheduler->finished (kjob);
+    Revalidation reval = it.value ();
+    revalidations.erase (it);
+    KIO::TransferJob *job = static_cast <KIO::TransferJob *> (kjob);
+    const QString code = job->queryMetaData ("responsecode");
+    const QString headers = job->queryMetaData ("HTTP-Headers");
+    EntryMap::iterator e = entries.find (reval.url);
+    if (kjob->error () || code == "304" || reval.data.isEmpty ()) {
+        if (code == "304" && e != entries.end ()) {
+            e.value ().expires = freshUntil (headers); // unchanged
+            scheduleSave ();
+        }
+        return; // else keep the copy we have when offline
+    }
+    if (e != entries.end () && mayStore (headers) &&
+            e.value ().hash == QString::fromLatin1 (QCryptographicHash::hash (
+                    reval.data, QCryptographicHash::Sha1).toHex ())) {
+        e.value ().expires = freshUntil (headers);
+        scheduleSave ();
+        return;
+    }
+    QString mime = job->mimetype ();
+    if (mime.isEmpty () && e != entries.end ())
+        mime = e.value ().mime;
+    store (reval.url, mime, reval.data, headers);
+    Q_EMIT updated (reval.url, mime,
+            mayStore (headers) ? reval.data : QByteArray (), freshUntil (headers));
+}
+
+//------------------------%<----------------------------------------------------
+
+DataCache::DataCache ()
+ : budget (32 * 1024 * 1024), bytes (0), stamp (0), disk (new DiskCache (this)),
+   hits (0), misses (0), disk_hits (0), evictions (0) {
+    connect (disk, &DiskCache::updated, this, &DataCache::diskUpdated);
+}
+
+void DataCache::setBudget (int kbytes) {
+    budget = qMax (0, kbytes) * Q_INT64_C (1024);
+    evict ();
+}
+
+void DataCache::setDiskBudget (int kbytes) {
+    disk->setBudget (kbytes);
+}
+
+void DataCache::add (const QString & url, const QString &mime,
+        const QByteArray & data, const QString &http_headers) {
+    if (!httpHeader (http_headers, "Cache-Control").contains ("no-store",
+                Qt::CaseInsensitive))
+        insert (url, mime, data, freshUntil (http_headers));
+    else
+        insert (url, mime, QByteArray (), 0); // drops an older copy
+    disk->store (url, mime, data, http_headers);
+    FetchMap::iterator it = in_flight.find (url);
+    if (it != in_flight.end ()) {
+        const QList <QPointer <MediaInfo> > waiters = it.value ().waiters;
+        in_flight.erase (it);
+        for (const QPointer <MediaInfo> &mi : waiters)
+            if (mi)
+                mi->fetchDone (mime, data);
+    }
+}
+
+void DataCache::diskUpdated (const QString &url, const QString &mime,
+        const QByteArray &data, qint64 expires) {
+    if (cache_map.contains (url))
+        insert (url, mime, data, expires); // next wget gets the fresh copy
 }
 
-bool DataCache::get (const QString & url, QString &mime, QByteArray & data) {
-    DataMap::const_iterator it = cache_map.constFind (url);
-    if (it != cache_map.constEnd ()) {
-        mime = it.value ().first;
-        data = it.value ().second;
+void DataCache::insert (const QString &url, const QString &mime,
+        const QByteArray &data, qint64 expires) {
+    DataMap::iterator it = cache_map.find (url);
+    if (data.isEmpty ()) {
+        // an empty array is never detached, so it could never be evicted
+        if (it != cache_map.end ()) {
+            bytes -= it.value ().data.size ();
+            cache_map.erase (it);
+        }
+        return;
+    }
+    if (it != cache_map.end ()) {
+        bytes -= it.value ().data.size ();
+    } else {
+        it = cache_map.insert (url, Entry ());
+    }
+    it.value ().mime = mime;
+    it.value ().data = data;
+    it.value ().used = ++stamp;
+    it.value ().expires = expires;
+    bytes += data.size ();
+    evict ();
+}
+
+bool DataCache::get (const QString & url, QString &mime, QByteArray & data,
+        bool allow_stale) {
+    DataMap::iterator it = cache_map.find (url);
+    if (it != cache_map.end ()) {
+        if (!allow_stale && !isFresh (it.value ().expires, it.value ().mime)) {
+            misses++;
+            return false;
+        }
+        mime = it.value ().mime;
+        data = it.value ().data;
+        it.value ().used = ++stamp;
+        hits++;
         return true;
     }
+    qint64 expires;
+    if (disk->get (url, mime, data, expires, allow_stale)) {
+        insert (url, mime, data, expires);
+        disk_hits++;
+        if (!expires)
+            disk->revalidate (url);
+        return true;
+    }
+    misses++;
     return false;
 }
 
-bool DataCache::preserve (const QString & url) {
-    PreserveMap::const_iterator it = preserve_map.constFind (url);
-    if (it == preserve_map.constEnd ()) {
-        preserve_map.insert (url, true);
+/* Keeps url while node is active, so a repeated node finds it again */
+void DataCache::pin (const QString &url, Node *node) {
+    DataMap::iterator it = cache_map.find (url);
+    if (it == cache_map.end () || !node)
+        return;
+    QList <NodePtrW> &pins = it.value ().pinned_by;
+    for (int i = 0; i < pins.size (); ++i)
+        if (pins[i].ptr () == node)
+            return;
+    pins.append (node);
+}
+
+void DataCache::unpin (const QString &url, Node *node) {
+    DataMap::iterator it = cache_map.find (url);
+    if (it == cache_map.end ())
+        return;
+    QList <NodePtrW> &pins = it.value ().pinned_by;
+    for (int i = 0; i < pins.size (); )
+        if (!pins[i] || pins[i].ptr () == node)
+            pins.removeAt (i);
+        else
+            ++i;
+}
+
+bool DataCache::evictable (Entry &entry) {
+    if (!entry.data.isDetached ())
+        return false; // still in use
+    QList <NodePtrW> &pins = entry.pinned_by;
+    for (int i = 0; i < pins.size (); ) {
+        if (pins[i] && pins[i]->active ())
+            return false;
+        pins.removeAt (i);
+    }
+    return true;
+}
+
+void DataCache::evict () {
+    while (bytes > budget) {
+        DataMap::iterator lru = cache_map.end ();
+        const DataMap::iterator e = cache_map.end ();
+        for (DataMap::iterator it = cache_map.begin (); it != e; ++it)
+            if ((lru == e || it.value ().used < lru.value ().used) &&
+                    evictable (it.value ()))
+                lru = it;
+        if (lru == e)
+            break; // all in use, allow exceeding the budget for now
+        qCDebug(LOG_KMPLAYER_COMMON) << "DataCache evict" << lru.key ()
+            << lru.value ().data.size ();
+        bytes -= lru.value ().data.size ();
+        cache_map.erase (lru);
+        evictions++;
+    }
+}
+
+/* Returns true if mi should download url, else it waits for the owner */
+bool DataCache::fetch (const QString &url, MediaInfo *mi) {
+    FetchMap::iterator it = in_flight.find (url);
+    if (it == in_flight.end ()) {
+        Fetch f;
+        f.owner = mi;
+        in_flight.insert (url, f);
         return true;
     }
+    it.value ().waiters.append (mi);
     return false;
 }
 
-bool DataCache::isPreserved (const QString & url) {
-    return preserve_map.find (url) != preserve_map.end ();
+/*
+ * Removes mi from the download of url. If mi was the owner, the first
+ * waiter is returned, which should continue the download for the others
+ */
+MediaInfo *DataCache::cancel (const QString &url, MediaInfo *mi) {
+    FetchMap::iterator it = in_flight.find (url);
+    if (it == in_flight.end ())
+        return nullptr;
+    QList <QPointer <MediaInfo> > &waiters = it.value ().waiters;
+    if (it.value ().owner != mi) {
+        waiters.removeAll (mi);
+        return nullptr;
+    }
+    while (!waiters.isEmpty ()) {
+        MediaInfo *next = waiters.takeFirst ();
+        if (next) {
+            it.value ().owner = next;
+            return next;
+        }
+    }
+    in_flight.erase (it);
+    return nullptr;
 }
 
-bool DataCache::unpreserve (const QString & url) {
-    const PreserveMap::iterator it = preserve_map.find (url);
-    if (it == preserve_map.end ())
-        return false;
-    preserve_map.erase (it);
-    Q_EMIT preserveRemoved (url);
-    return true;
+/*
+ * The owner gave up on url. The waiters get the stale copy the owner fell
+ * back on, if any, else try again themselves
+ */
+void DataCache::failed (const QString &url, const QString &stale_mime,
+        const QByteArray &stale_data) {
+    FetchMap::iterator it = in_flight.find (url);
+    if (it == in_flight.end ())
+        return;
+    const QList <QPointer <MediaInfo> > waiters = it.value ().waiters;
+    in_flight.erase (it);
+    for (const QPointer <MediaInfo> &mi : waiters)
+        if (mi) {
+            if (stale_data.isEmpty ())
+                mi->fetchFailed ();
+            else
+                mi->fetchDone (stale_mime, stale_data);
+        }
 }
 
 //------------------------%<----------------------------------------------------
@@ -374,35 +1107,400 @@ static bool isPlayListMime (const QString & mime) {
             !strcmp (mimestr, "application/x-mplayer2"));
 }
 
+static QMimeDatabase &mimeDatabase ()
+{
+    static QMimeDatabase db;
+    return db;
+}
+
 static QString mimeByContent (const QByteArray &data)
 {
-    const QMimeType mimeType = QMimeDatabase().mimeTypeForData(data);
+    const char *sniffed = sniffMime (data);
+    if (sniffed)
+        return QString::fromLatin1 (sniffed);
+    const QMimeType mimeType = mimeDatabase ().mimeTypeForData (data);
     if (mimeType.isValid())
         return mimeType.name ();
     return QString ();
 }
 
+PrefetchScheduler::PrefetchScheduler ()
+ : max_bytes (4 * 1024 * 1024), max_jobs (2) {}
+
+void PrefetchScheduler::setBudget (int bytes, int jobs) {
+    max_bytes = bytes;
+    max_jobs = jobs;
+    update ();
+}
+
+void PrefetchScheduler::request (MediaInfo *mi) {
+    if (!pending.contains (mi) && !fetched.contains (mi)) {
+        mi->prefetch_state = MediaInfo::PrefetchQueued;
+        pending.append (mi);
+        update ();
+    }
+}
+
+void PrefetchScheduler::release (MediaInfo *mi) {
+    if (MediaInfo::PrefetchNone != mi->prefetch_state) {
+        mi->prefetch_state = MediaInfo::PrefetchNone;
+        pending.removeAll (mi);
+        if (fetched.removeAll (mi))
+            update ();
+    }
+}
+
+void PrefetchScheduler::update () {
+    int jobs = 0;
+    int bytes = 0;
+    for (QList <MediaInfo *>::const_iterator i = fetched.constBegin ();
+            i != fetched.constEnd ();
+            ++i) {
+        if ((*i)->downloading ())
+            ++jobs;
+        bytes += (*i)->data.size () + (*i)->received.size ();
+    }
+    while (!pending.isEmpty () && jobs < max_jobs && bytes < max_bytes) {
+        MediaInfo *mi = pending.takeFirst ();
+        fetched.append (mi);
+        mi->prefetch_state = MediaInfo::PrefetchStarted;
+        mi->wget (QString (mi->url));
+        if (mi->downloading ())
+            ++jobs;
+        bytes += mi->data.size ();
+    }
+}
+
+//------------------------%<----------------------------------------------------
+
+FetchScheduler::FetchScheduler () : max_jobs (8), max_host_jobs (4) {}
+
+void FetchScheduler::setLimits (int jobs, int host_jobs) {
+    max_jobs = qMax (1, jobs);
+    max_host_jobs = qMax (1, host_jobs);
+    update ();
+}
+
+void FetchScheduler::request (MediaInfo *mi, const QUrl &url) {
+    Request r;
+    r.mi = mi;
+    r.cache = nullptr;
+    r.url = url;
+    mi->fetch_queued = true;
+    queued [mi->fetch_priority].append (r);
+    update ();
+}
+
+void FetchScheduler::revalidate (DiskCache *cache, const QUrl &url) {
+    Request r;
+    r.mi = nullptr;
+    r.cache = cache;
+    r.url = url;
+    queued [Prefetch].append (r);
+    update ();
+}
+
+void FetchScheduler::cancel (MediaInfo *mi) {
+    mi->fetch_queued = false;
+    for (int p = Active; p <= Thumbnail; ++p)
+        for (int i = 0; i < queued [p].size (); ++i)
+            if (queued [p][i].mi == mi) {
+                queued [p].removeAt (i);
+                return;
+            }
+}
+
+void FetchScheduler::cancel (DiskCache *cache) {
+    for (int p = Active; p <= Thumbnail; ++p)
+        for (int i = 0; i < queued [p].size (); )
+            if (queued [p][i].cache == cache)
+                queued [p].removeAt (i);
+            else
+                ++i;
+}
+
+/* The download of mi is continued by with, at its priority if higher */
+void FetchScheduler::replace (MediaInfo *mi, MediaInfo *with) {
+    for (int p = Active; p <= Thumbnail; ++p)
+        for (int i = 0; i < queued [p].size (); ++i)
+            if (queued [p][i].mi == mi) {
+                mi->fetch_queued = false;
+                with->fetch_queued = true;
+                queued [p][i].mi = with;
+                if (with->fetch_priority < p) {
+                    queued [with->fetch_priority].append (queued [p].takeAt (i));
+                    update ();
+                }
+                return;
+            }
+}
+
+/* A node began or is about to, move its queued download up front */
+void FetchScheduler::raise (const QString &url, Priority priority) {
+    bool moved = false;
+    for (int p = priority + 1; p <= Thumbnail; ++p)
+        for (int i = 0; i < queued [p].size (); )
+            if (queued [p][i].mi && queued [p][i].mi->url == url) {
+                queued [p][i].mi->fetch_priority = priority;
+                queued [priority].append (queued [p].takeAt (i));
+                moved = true;
+            } else {
+                ++i;
+            }
+    if (moved)
+        update ();
+}
+
+void FetchScheduler::finished (KJob *job) {
+    QMap <KJob *, QString>::iterator it = running.find (job);
+    if (it != running.end ()) {
+        QMap <QString, int>::iterator h = host_jobs.find (it.value ());
+        if (h != host_jobs.end () && --h.value () <= 0)
+            host_jobs.erase (h);
+        running.erase (it);
+        update ();
+    }
+}
+
+void FetchScheduler::update () {
+    for (int p = Active; p <= Thumbnail; ++p) {
+        const int limit = Active == p ? max_jobs : qMax (1, max_jobs - 1);
+        for (int i = 0; i < queued [p].size () && running.size () < limit; ) {
+            const QString host = queued [p][i].url.host ();
+            if (host_jobs.value (host) >= max_host_jobs) {
+                ++i;
+                continue;
+            }
+            Request r = queued [p].takeAt (i);
+            KJob *job;
+            if (r.mi) {
+                r.mi->startJob (r.url);
+                job = r.mi->job;
+            } else {
+                job = r.cache->startRevalidation (r.url);
+            }
+            if (job) {
+                ++host_jobs [host];
+                running.insert (job, host);
+            }
+        }
+    }
+}
+
+//------------------------%<----------------------------------------------------
+
+static const qint64 policy_expire_ms = 30 * 60 * 1000;
+static const qint64 policy_retry_ms = 30 * 1000; // after a failed fetch
+
+CrossDomainPolicies::Access CrossDomainPolicies::check (
+        const QString &policy_url, const QString &domain, MediaInfo *mi) {
+    QMap <QString, Policy>::iterator it = policies.find (policy_url);
+    if (it != policies.end ()) {
+        if (it.value ().expires > QDateTime::currentMSecsSinceEpoch ())
+            return allows (policy_url, domain) ? Allowed : Denied;
+        policies.erase (it);
+    }
+    QMap <QString, Fetch>::iterator f = in_flight.find (policy_url);
+    if (f != in_flight.end ()) {
+        f.value ().waiters.append (mi);
+        return Waiting;
+    }
+    Fetch fetch;
+    fetch.owner = mi;
+    in_flight.insert (policy_url, fetch);
+    return Unknown;
+}
+
+bool CrossDomainPolicies::allows (const QString &policy_url, const QString &domain) {
+    QMap <QString, Policy>::iterator it = policies.find (policy_url);
+    if (it == policies.end ())
+        return false;
+    Policy &policy = it.value ();
+    QMap <QString, bool>::const_iterator d = policy.decisions.constFind (domain);
+    if (d != policy.decisions.constEnd ())
+        return d.value ();
+    bool allowed = false;
+    for (int i = 0; i < policy.allow.size () && !allowed; ++i)
+        allowed = policy.allow[i].exactMatch (domain);
+    policy.decisions.insert (domain, allowed);
+    return allowed;
+}
+
+/*
+ * Stores the policy, an empty xml denies all, and answers the waiters.
+ * A failed fetch denies too, but is fetched again soon after.
+ */
+void CrossDomainPolicies::done (const QString &policy_url,
+        const QByteArray &xml, bool failed) {
+    Policy policy;
+    policy.expires = QDateTime::currentMSecsSinceEpoch () +
+        (failed ? policy_retry_ms : policy_expire_ms);
+    if (xml.size () > 0) {
+        QTextStream ts (xml, QIODevice::ReadOnly);
+        NodePtr doc = new Document (QString ());
+        readXML (doc, ts, QString ());
+
+        Expression *expr = evaluateExpr (
+                "//cross-domain-policy/allow-access-from/@domain");
+        if (expr) {
+            expr->setRoot (doc);
+            Expression::iterator it, e = expr->end();
+            for (it = expr->begin(); it != e; ++it)
+                policy.allow.append (QRegExp (it->value(),
+                            Qt::CaseInsensitive, QRegExp::Wildcard));
+            delete expr;
+        }
+        doc->document ()->dispose ();
+    }
+    policies.insert (policy_url, policy);
+
+    QMap <QString, Fetch>::iterator f = in_flight.find (policy_url);
+    if (f == in_flight.end ())
+        return;
+    const QList <QPointer <MediaInfo> > waiters = f.value ().waiters;
+    in_flight.erase (f);
+    for (const QPointer <MediaInfo> &mi : waiters)
+        if (mi)
+            mi->accessChecked (allows (policy_url, mi->access_from));
+}
+
+/* If mi was fetching the policy, the waiters ask again, one will fetch */
+void CrossDomainPolicies::cancel (const QString &policy_url, MediaInfo *mi) {
+    QMap <QString, Fetch>::iterator f = in_flight.find (policy_url);
+    if (f == in_flight.end ())
+        return;
+    if (f.value ().owner != mi) {
+        f.value ().waiters.removeAll (mi);
+        return;
+    }
+    const QList <QPointer <MediaInfo> > waiters = f.value ().waiters;
+    in_flight.erase (f);
+    for (const QPointer <MediaInfo> &w : waiters)
+        if (w) {
+            w->policy_wait = false;
+            w->wget (QString (w->url), QString (w->access_from));
+        }
+}
+
+//------------------------%<----------------------------------------------------
+
 MediaInfo::MediaInfo (Node *n, MediaManager::MediaType t)
  : media (nullptr), type (t), node (n), job (nullptr),
-    preserve_wait (false), check_access (false) {
+    inflight_wait (false), check_access (false),
+    fetch_queued (false), policy_wait (false), thumbnail (false),
+    fetch_priority (FetchScheduler::Active),
+    prefetch_state (PrefetchNone) {
 }
 
 MediaInfo::~MediaInfo () {
+    if (prefetch_scheduler)
+        prefetch_scheduler->release (this);
     clearData ();
 }
 
+/**
+ * Lets the prefetch scheduler start downloading url when budget allows
+ */
+void MediaInfo::prefetch (const QString &str, FetchScheduler::Priority p) {
+    clearData ();
+    url = str;
+    fetch_priority = thumbnail ? FetchScheduler::Thumbnail : p;
+    if (prefetch_scheduler)
+        prefetch_scheduler->request (this);
+}
+
+/**
+ * Node begins, download now if still queued and stop counting it as prefetch
+ */
+void MediaInfo::claim () {
+    bool queued = PrefetchQueued == prefetch_state;
+    if (prefetch_scheduler)
+        prefetch_scheduler->release (this);
+    fetch_priority = activePriority ();
+    if (queued)
+        wget (QString (url));
+    else if (fetch_queued || inflight_wait)
+        fetch_scheduler->raise (url, fetch_priority);
+}
+
+FetchScheduler::Priority MediaInfo::activePriority () const {
+    return thumbnail ? FetchScheduler::Thumbnail : FetchScheduler::Active;
+}
+
 void MediaInfo::killWGet () {
-    if (job) {
-        job->kill (); // quiet, no result signal
+    if (!memory_cache) { // outlived the last MediaManager
+        if (job)
+            job->kill ();
+        job = nullptr;
+        received.clear ();
+        fetch_queued = inflight_wait = policy_wait = check_access = false;
+        return;
+    }
+    if (job || fetch_queued) {
+        MediaInfo *next = check_access
+            ? nullptr // the cross-domain policy, not a shared download
+            : memory_cache->cancel (url, this);
+        if (next) {
+            next->takeOver (this);
+        } else if (fetch_queued) {
+            fetch_scheduler->cancel (this);
+        } else {
+            fetch_scheduler->finished (job);
+            job->kill (); // quiet, no result signal
+        }
         job = nullptr;
-        memory_cache->unpreserve (url);
-    } else if (preserve_wait) {
-        disconnect (memory_cache, &DataCache::preserveRemoved,
-                    this, &MediaInfo::cachePreserveRemoved);
-        preserve_wait = false;
+        received.clear ();
+        if (check_access) {
+            check_access = false;
+            cross_domain_policies->cancel (cross_domain, this);
+        }
+    } else if (inflight_wait) {
+        memory_cache->cancel (url, this);
+        inflight_wait = false;
+    } else if (policy_wait) {
+        cross_domain_policies->cancel (cross_domain, this);
+        policy_wait = false;
     }
 }
 
+/* Continues the download of owner, which got cancelled */
+void MediaInfo::takeOver (MediaInfo *owner) {
+    inflight_wait = false;
+    if (owner->fetch_queued) {
+        fetch_scheduler->replace (owner, this);
+        return;
+    }
+    job = owner->job;
+    owner->job = nullptr;
+    received = owner->received;
+    owner->received.clear ();
+    disconnect (job, nullptr, owner, nullptr);
+    connect (job, &KIO::TransferJob::data,
+            this, &MediaInfo::slotData);
+    connect (job, &KJob::result,
+            this, &MediaInfo::slotResult);
+    connect (job, QOverload<KIO::Job*, const QString&>::of(&KIO::TransferJob::mimetype),
+            this, &MediaInfo::slotMimetype);
+    if (!owner->mime.isEmpty ())
+        slotMimetype (job, owner->mime); // may not want the rest
+}
+
+void MediaInfo::fetchDone (const QString &m, const QByteArray &ba) {
+    inflight_wait = false;
+    data = ba;
+    if (memory_cache)
+        memory_cache->pin (url, node);
+    setMimetype (m);
+    if (MediaManager::Any == type)
+        type = MediaManager::AudioVideo;
+    ready ();
+}
+
+void MediaInfo::fetchFailed () {
+    inflight_wait = false;
+    wget (QString (url));
+}
+
 /**
  * Gets contents from url and puts it in m_data
  */
@@ -410,9 +1508,11 @@ bool MediaInfo::wget(const QString& str, const QString& domain) {
     clearData ();
     url = str;
 
-    if (MediaManager::Any == type || MediaManager::Image == type) {
+    if (image_data_map &&
+            (MediaManager::Any == type || MediaManager::Image == type)) {
         ImageDataMap::iterator i = image_data_map->find (str);
         if (i != image_data_map->end ()) {
+            image_cache->touch (str);
             media = new ImageMedia (node, i.value ());
             type = MediaManager::Image;
             ready ();
@@ -460,9 +1560,21 @@ bool MediaInfo::wget(const QString& str, const QString& domain) {
         QFile file (kurl.toLocalFile ());
         if (file.exists ()) {
             if (MediaManager::Data != type && mime.isEmpty ()) {
-                const QMimeType mimeTyoe = QMimeDatabase().mimeTypeForUrl (kurl);
-                if (mrl && mimeTyoe.isValid()) {
-                    mrl->mimetype = mimeTyoe.name ();
+                // by the magic of its first bytes, else by its name
+                QString mt;
+                if (file.open (QIODevice::ReadOnly)) {
+                    const char *sniffed = sniffMime (file.read (1024));
+                    file.close ();
+                    if (sniffed)
+                        mt = QString::fromLatin1 (sniffed);
+                }
+                if (mt.isEmpty ()) {
+                    const QMimeType mimeType = mimeDatabase ().mimeTypeForUrl (kurl);
+                    if (mimeType.isValid ())
+                        mt = mimeType.name ();
+                }
+                if (mrl && !mt.isEmpty ()) {
+                    mrl->mimetype = mt;
                     setMimetype (mrl->mimetype);
                 }
                 qCDebug(LOG_KMPLAYER_COMMON) << "wget2 " << str << " " << mime;
@@ -472,6 +1584,17 @@ bool MediaInfo::wget(const QString& str, const QString& domain) {
             only_playlist = MediaManager::Audio == type ||
                 MediaManager::AudioVideo == type;
             maybe_playlist = isPlayListMime (mime); // get new mime
+            MediaManager *mgr = (MediaManager *) node->document ()->role (
+                    RoleMediaManager);
+            if (MediaManager::Image == type && mgr && !media &&
+                    mime.startsWith ("image/") && mime != "image/svg+xml" &&
+                    mime != "image/vnd.rn-realpix") {
+                // decoded from a mapping of the file on a decoder thread
+                media = new ImageMedia (mgr, node, str, QByteArray (),
+                        file.fileName ());
+                ready ();
+                return true;
+            }
             if (file.open (QIODevice::ReadOnly)) {
                 if (only_playlist) {
                     maybe_playlist &= file.size () < 2000000;
@@ -489,6 +1612,21 @@ bool MediaInfo::wget(const QString& str, const QString& domain) {
                     }
                     file.reset ();
                 }
+                // playlists and text are parsed right away in ready (),
+                // large ones are read from a private mapping meanwhile
+                const qint64 size = file.size ();
+                uchar *mapped = nullptr;
+                if (MediaManager::Image != type && MediaManager::Data != type &&
+                        size >= 64 * 1024 && size <= 0x7fffffff)
+                    mapped = file.map (0, size, QFileDevice::MapPrivateOption);
+                if (mapped) {
+                    data = QByteArray::fromRawData ((const char *) mapped, size);
+                    ready ();
+                    mimetype (); // sniffed while the contents are at hand
+                    data = QByteArray (); // parsed, only Data is kept
+                    file.close (); // unmaps
+                    return true;
+                }
                 data = file.readAll ();
                 file.close ();
             }
@@ -496,14 +1634,30 @@ bool MediaInfo::wget(const QString& str, const QString& domain) {
         ready ();
         return true;
     }
+    if (!memory_cache) { // outlived the last MediaManager, can't download
+        ready ();
+        return true;
+    }
     QString protocol = kurl.scheme ();
     if (!domain.isEmpty ()) {
         QString get_from = protocol + "://" + kurl.host ();
         if (get_from != domain) {
-            check_access = true;
             access_from = domain;
             cross_domain = get_from + "/crossdomain.xml";
-            kurl = QUrl (cross_domain);
+            switch (cross_domain_policies->check (cross_domain, domain, this)) {
+            case CrossDomainPolicies::Denied:
+                ready ();
+                return true;
+            case CrossDomainPolicies::Waiting:
+                policy_wait = true;
+                return false;
+            case CrossDomainPolicies::Unknown:
+                check_access = true;
+                kurl = QUrl (cross_domain);
+                break;
+            default: // allowed by a known policy
+                break;
+            }
         }
     }
     if (!check_access) {
@@ -512,6 +1666,7 @@ bool MediaInfo::wget(const QString& str, const QString& domain) {
                  protocol == "mms" || protocol == "rtsp" ||
                  protocol == "rtp" || protocol == "rtmp" ||
                  (only_playlist && !maybe_playlist && !mime.isEmpty ()))) {
+            memory_cache->pin (str, node);
             setMimetype (mime);
             if (MediaManager::Any == type)
                 type = MediaManager::AudioVideo;
@@ -519,27 +1674,44 @@ bool MediaInfo::wget(const QString& str, const QString& domain) {
             return true;
         }
     }
-    if (check_access || memory_cache->preserve (str)) {
-        //qCDebug(LOG_KMPLAYER_COMMON) << "downloading " << str;
-        job = KIO::get (kurl, KIO::NoReload, KIO::HideProgressInfo);
-        job->addMetaData ("PropagateHttpHeader", "true");
-        job->addMetaData ("errorPage", "false");
-        connect (job, &KIO::TransferJob::data,
-                this, &MediaInfo::slotData);
-        connect (job, &KJob::result,
-                this, &MediaInfo::slotResult);
-        if (!check_access)
-            connect (job, QOverload<KIO::Job*, const QString&>::of(&KIO::TransferJob::mimetype),
-                    this, &MediaInfo::slotMimetype);
+    if (check_access || memory_cache->fetch (str, this)) {
+        if (PrefetchNone == prefetch_state)
+            fetch_priority = activePriority ();
+        fetch_scheduler->request (this, kurl);
     } else {
-        //qCDebug(LOG_KMPLAYER_COMMON) << "download preserved " << str;
-        connect (memory_cache, &DataCache::preserveRemoved,
-                 this, &MediaInfo::cachePreserveRemoved);
-        preserve_wait = true;
+        //qCDebug(LOG_KMPLAYER_COMMON) << "download in flight " << str;
+        inflight_wait = true;
     }
     return false;
 }
 
+/* The cross-domain policy is known, get url or give up on it */
+void MediaInfo::accessChecked (bool allowed) {
+    policy_wait = false;
+    if (allowed) {
+        wget (QString (url));
+    } else {
+        data.resize (0);
+        ready ();
+    }
+}
+
+/* Called by the fetch scheduler when it's our turn */
+void MediaInfo::startJob (const QUrl &kurl) {
+    //qCDebug(LOG_KMPLAYER_COMMON) << "downloading " << kurl;
+    fetch_queued = false;
+    job = KIO::get (kurl, KIO::NoReload, KIO::HideProgressInfo);
+    job->addMetaData ("PropagateHttpHeader", "true");
+    job->addMetaData ("errorPage", "false");
+    connect (job, &KIO::TransferJob::data,
+            this, &MediaInfo::slotData);
+    connect (job, &KJob::result,
+            this, &MediaInfo::slotResult);
+    if (!check_access)
+        connect (job, QOverload<KIO::Job*, const QString&>::of(&KIO::TransferJob::mimetype),
+                this, &MediaInfo::slotMimetype);
+}
+
 bool MediaInfo::readChildDoc () {
     QTextStream textstream (data, QIODevice::ReadOnly);
     QString line;
@@ -662,17 +1834,22 @@ QString MediaInfo::mimetype () {
 void MediaInfo::clearData () {
     killWGet ();
     if (media) {
+        if (MediaManager::Image == media->type ())
+            static_cast <ImageMedia *> (media)->cancelDecode ();
         media->destroy ();
         media = nullptr;
     }
+    if (memory_cache && !url.isEmpty ())
+        memory_cache->unpin (url, node);
     url.truncate (0);
     mime.truncate (0);
     access_from.truncate (0);
+    received.clear ();
     data.resize (0);
 }
 
 bool MediaInfo::downloading () const {
-    return !!job;
+    return job || fetch_queued || policy_wait;
 }
 
 void MediaInfo::create () {
@@ -713,6 +1890,9 @@ void MediaInfo::create () {
 void MediaInfo::ready () {
     if (MediaManager::Data != type) {
         create ();
+        if (media && MediaManager::Image == media->type () &&
+                static_cast <ImageMedia *> (media)->decoding ())
+            return; // ImageMedia posts MsgMediaReady when decoded
         if (id_node_record_document == node->id)
             node->message (MsgMediaReady);
         else
@@ -737,73 +1917,56 @@ static bool validDataFormat (MediaManager::MediaType type, const QByteArray &ba)
 
 void MediaInfo::slotResult (KJob *kjob) {
     job = nullptr; // signal KIO::Job::result deletes itself
+    data = received.flatten ();
+    received.clear ();
+    if (!memory_cache) {
+        ready ();
+        return;
+    }
+    fetch_scheduler->finished (kjob);
     if (check_access) {
         check_access = false;
-
-        bool success = false;
-        if (!kjob->error () && data.size () > 0) {
-            QTextStream ts (data, QIODevice::ReadOnly);
-            NodePtr doc = new Document (QString ());
-            readXML (doc, ts, QString ());
-
-            Expression *expr = evaluateExpr (
-                    "//cross-domain-policy/allow-access-from/@domain");
-            if (expr) {
-                expr->setRoot (doc);
-                Expression::iterator it, e = expr->end();
-                for (it = expr->begin(); it != e; ++it) {
-                    QRegExp match (it->value(), Qt::CaseInsensitive, QRegExp::Wildcard);
-                    if (match.exactMatch (access_from)) {
-                        success = true;
-                        break;
-                    }
-                }
-                delete expr;
-            }
-            doc->document ()->dispose ();
-        }
-        if (success) {
-            wget (QString (url));
-        } else {
-            data.resize (0);
-            ready ();
-        }
+        cross_domain_policies->done (cross_domain,
+                kjob->error () ? QByteArray () : data, kjob->error ());
+        accessChecked (cross_domain_policies->allows (cross_domain, access_from));
     } else {
+        bool prefetched = PrefetchStarted == prefetch_state;
         if (MediaManager::Data != type && !kjob->error ()) {
             if (data.size () && data.size () < 512) {
                 setMimetype (mimeByContent (data));
                 if (!validDataFormat (type, data))
                     data.resize (0);
             }
-            memory_cache->add (url, mime, data);
+            memory_cache->add (url, mime, data,
+                    static_cast <KIO::Job *> (kjob)->queryMetaData ("HTTP-Headers"));
+            memory_cache->pin (url, node);
+        } else if (MediaManager::Data != type &&
+                memory_cache->get (url, mime, data, true)) {
+            // server unreachable, an expired copy is better than nothing
+            qCDebug(LOG_KMPLAYER_COMMON) << "serving stale" << url;
+            setMimetype (mime);
+            memory_cache->failed (url, mime, data);
+            memory_cache->pin (url, node);
         } else {
-            memory_cache->unpreserve (url);
+            memory_cache->failed (url);
             if (MediaManager::Data != type)
                 data.resize (0);
         }
         ready ();
-    }
-}
-
-void MediaInfo::cachePreserveRemoved (const QString & str) {
-    if (str == url && !memory_cache->isPreserved (str)) {
-        preserve_wait = false;
-        disconnect (memory_cache, &DataCache::preserveRemoved,
-                    this, &MediaInfo::cachePreserveRemoved);
-        wget (str);
+        if (prefetched && prefetch_scheduler)
+            prefetch_scheduler->update ();
     }
 }
 
 void MediaInfo::slotData (KIO::Job *, const QByteArray &qb) {
     if (qb.size ()) {
-        int old_size = data.size ();
-        int newsize = old_size + qb.size ();
-        data.resize (newsize);
-        memcpy (data.data () + old_size, qb.constData (), qb.size ());
-        if (!check_access && old_size < 512 && newsize >= 512) {
-            setMimetype (mimeByContent (data));
-            if (!validDataFormat (type, data)) {
-                data.resize (0);
+        int old_size = received.size ();
+        received.append (qb);
+        if (!check_access && old_size < 512 && received.size () >= 512) {
+            const QByteArray head = received.head (512);
+            setMimetype (mimeByContent (head));
+            if (!validDataFormat (type, head)) {
+                received.clear ();
                 job->kill (KJob::EmitResult);
                 return;
             }
@@ -971,9 +2134,6 @@ ImageData::ImageData( const QString & img)
    flags (0),
    has_alpha (false),
    image (nullptr),
-#ifdef KMPLAYER_WITH_CAIRO
-   surface (nullptr),
-#endif
    url (img) {
     //if (img.isEmpty ())
     //    //qCDebug(LOG_KMPLAYER_COMMON) << "New ImageData for " << this << endl;
@@ -982,24 +2142,14 @@ ImageData::ImageData( const QString & img)
 }
 
 ImageData::~ImageData() {
-    if (!url.isEmpty ())
+    if (!url.isEmpty () && image_data_map)
         image_data_map->remove (url);
-#ifdef KMPLAYER_WITH_CAIRO
-    if (surface)
-        cairo_surface_destroy (surface);
-#endif
     delete image;
 }
 
 void ImageData::setImage (QImage *img) {
     if (image != img) {
         delete image;
-#ifdef KMPLAYER_WITH_CAIRO
-        if (surface) {
-            cairo_surface_destroy (surface);
-            surface = nullptr;
-        }
-#endif
         image = img;
         if (img) {
             width = img->width ();
@@ -1011,11 +2161,371 @@ void ImageData::setImage (QImage *img) {
     }
 }
 
+ImageCache::ImageCache () : hits (0), misses (0), cache (64 * 1024) {}
+
+ImageCache::~ImageCache () {
+    qCDebug(LOG_KMPLAYER_COMMON) << "image cache" << hits << "hits" << misses
+        << "misses" << residentKBytes () << "KiB resident";
+}
+
+ImageCache *ImageCache::instance () {
+    return image_cache;
+}
+
+void ImageCache::setBudget (int kbytes) {
+    cache.setMaxCost (qMax (0, kbytes));
+}
+
+/**
+ * Keeps a decoded image for url, so that it is not downloaded and decoded
+ * again when it is used after the last node showing it finished
+ */
+void ImageCache::retain (ImageDataPtr img, const QString &url) {
+    Entry *e = new Entry;
+    e->decoded = img;
+    cache.insert (url, e, qMax (1, img->width * img->height * 4 / 1024));
+    misses++; // had to be decoded
+}
+
+/* A decoded image for url is used again */
+void ImageCache::touch (const QString &url) {
+    cache.object (url);
+    hits++;
+}
+
+/* The decoded image currently shared by all users of url */
+ImageDataPtrW ImageCache::shared (const QString &url) const {
+    return image_data_map->value (url);
+}
+
+//------------------------%<----------------------------------------------------
+
+namespace {
+
+    /*
+     * Decoding state of an AnimatedImage, used by its pool job. When the
+     * animation goes away while the job runs, the job deletes it.
+     */
+    struct AnimationDecoder {
+        struct Frame {
+            QImage image;
+            int delay;
+        };
+        AnimationDecoder (const QByteArray &ba);
+        ~AnimationDecoder ();
+        void restart ();
+        void decodeAhead ();
+
+        QByteArray data;
+        QBuffer *buffer;      // these three only used by the running job
+        QImageReader *reader;
+        int loops;
+        QMutex mutex;
+        QQueue <Frame> ring;
+        int ring_size;
+        bool filling;         // a job is queued or running
+        bool at_end;
+        bool cancelled;       // the AnimatedImage is gone
+    };
+
+    class AnimatedImageJob : public QRunnable {
+    public:
+        AnimatedImageJob (AnimationDecoder *d) : decoder (d) {}
+        void run () override;
+    private:
+        AnimationDecoder *decoder;
+    };
+
+}
+
+/*
+ * Frames of an animated image, decoded ahead on the image decoder pool into
+ * a small ring and shared by every ImageMedia showing the same url. Flips
+ * are driven by the ImageMedia's document timers against one clock, so all
+ * of them show the same frame.
+ */
+class KMPlayer::AnimatedImage
+{
+public:
+    AnimatedImage (const QString &url, const QByteArray &data, const QImage &first);
+    ~AnimatedImage ();
+
+    int advance ();
+    void rewind ();
+
+    ImageDataPtr frame;
+    unsigned int serial;
+
+private:
+    void fill ();
+
+    QString url;
+    AnimationDecoder *decoder;
+    QElapsedTimer clock;
+    qint64 next_flip;
+};
+
+void AnimatedImageJob::run () {
+    decoder->decodeAhead ();
+}
+
+AnimationDecoder::AnimationDecoder (const QByteArray &ba)
+ : data (ba),
+   buffer (new QBuffer (&data)),
+   reader (nullptr),
+   loops (0),
+   ring_size (2),
+   filling (false),
+   at_end (false),
+   cancelled (false) {
+    buffer->open (QIODevice::ReadOnly);
+    reader = new QImageReader (buffer);
+    loops = reader->loopCount ();
+}
+
+AnimationDecoder::~AnimationDecoder () {
+    delete reader;
+    delete buffer;
+}
+
+/* Reads from the first frame again, only while no job runs */
+void AnimationDecoder::restart () {
+    delete reader;
+    buffer->seek (0);
+    reader = new QImageReader (buffer);
+}
+
+void AnimationDecoder::decodeAhead () {
+    int pass_frames = 0;
+    while (true) {
+        mutex.lock ();
+        if (cancelled || ring.size () >= ring_size) {
+            const bool orphan = cancelled;
+            filling = false;
+            mutex.unlock ();
+            if (orphan)
+                delete this;
+            return;
+        }
+        mutex.unlock ();
+
+        Frame f;
+        f.image = reader->read ();
+        if (f.image.isNull () && pass_frames && loops) {
+            restart (); // rewind for the next loop
+            if (loops > 0)
+                --loops;
+            pass_frames = 0;
+            f.image = reader->read ();
+        }
+        if (!f.image.isNull ()) {
+            ++pass_frames;
+            f.image = f.image.convertToFormat (f.image.hasAlphaChannel ()
+                    ? QImage::Format_ARGB32_Premultiplied
+                    : QImage::Format_RGB32);
+            f.delay = reader->nextImageDelay ();
+            if (f.delay <= 10)
+                f.delay = 100; // like browsers do
+        }
+
+        mutex.lock ();
+        if (f.image.isNull ()) {
+            const bool orphan = cancelled;
+            at_end = true;
+            filling = false;
+            mutex.unlock ();
+            if (orphan)
+                delete this;
+            return;
+        }
+        ring.enqueue (f);
+        mutex.unlock ();
+    }
+}
+
+AnimatedImage::AnimatedImage (const QString &u, const QByteArray &ba,
+        const QImage &first)
+ : frame (new ImageData (QString ())),
+   serial (0),
+   url (u),
+   decoder (new AnimationDecoder (ba)),
+   next_flip (0) {
+    frame->setImage (new QImage (first));
+    frame->flags = (short)(ImageData::ImagePixmap | ImageData::ImageAnimated);
+    // keep at most 8 MiB of frames ahead
+    qint64 frame_bytes = qMax ((qint64) 1, (qint64) first.sizeInBytes ());
+    decoder->ring_size = (int) qBound ((qint64) 2,
+            8 * 1024 * 1024 / frame_bytes, (qint64) 8);
+    fill ();
+}
+
+AnimatedImage::~AnimatedImage () {
+    decoder->mutex.lock ();
+    decoder->cancelled = true;
+    const bool running = decoder->filling;
+    decoder->mutex.unlock ();
+    if (!running)
+        delete decoder; // else the job does when it sees cancelled
+    if (animated_images) {
+        AnimatedImageMap::iterator i = animated_images->find (url);
+        if (i != animated_images->end () &&
+                (!i.value () || i.value ().ptr () == this))
+            animated_images->erase (i);
+    }
+}
+
+void AnimatedImage::fill () {
+    QMutexLocker lock (&decoder->mutex);
+    if (decoder->filling || decoder->at_end ||
+            decoder->ring.size () >= decoder->ring_size)
+        return;
+    decoder->filling = true;
+    lock.unlock ();
+    image_decoder->start (new AnimatedImageJob (decoder));
+}
+
+/* Starts a finished animation over, for an ImageMedia that plays it again */
+void AnimatedImage::rewind () {
+    QMutexLocker lock (&decoder->mutex);
+    if (!decoder->at_end || decoder->filling || !decoder->ring.isEmpty ())
+        return;
+    decoder->restart ();
+    decoder->loops = decoder->reader->loopCount ();
+    decoder->at_end = false;
+    lock.unlock ();
+    next_flip = clock.isValid () ? clock.elapsed () : 0;
+    fill ();
+}
+
+/* Flips all due frames, returns the ms until the next flip or -1 when done */
+int AnimatedImage::advance () {
+    if (!clock.isValid ())
+        clock.start ();
+    qint64 now = clock.elapsed ();
+    if (now - next_flip > 1000)
+        next_flip = now; // nobody watched for a while, don't race to catch up
+    QImage image;
+    decoder->mutex.lock ();
+    while (now >= next_flip && !decoder->ring.isEmpty ()) {
+        AnimationDecoder::Frame f = decoder->ring.dequeue ();
+        image = f.image;
+        next_flip += f.delay;
+    }
+    bool finished = decoder->ring.isEmpty () && decoder->at_end &&
+        now >= next_flip;
+    decoder->mutex.unlock ();
+    if (!image.isNull ()) {
+        frame->setImage (new QImage (image));
+        ++serial;
+    }
+    fill ();
+    if (finished)
+        return -1;
+    return next_flip > now ? int (next_flip - now) : 10; // starved, retry soon
+}
+
+//------------------------%<----------------------------------------------------
+
+/*
+ * Rasterisations of an SVG at bucketed sizes, most recently used first.
+ * Each reparse of the SVG starts a new generation, older ones are only
+ * shown until the current one is rendered.
+ */
+class KMPlayer::SvgRasterCache
+{
+public:
+    struct Raster {
+        QSize size;
+        unsigned int generation;
+        QImage image;
+    };
+
+    SvgRasterCache (const QByteArray &x)
+     : xml (x), generation (0), render_id (0), render_generation (0),
+       shown_generation (0) {}
+
+    const Raster *find (const QSize &size);
+    const Raster *nearest (const QSize &size) const;
+    void insert (const QSize &size, unsigned int gen, const QImage &img);
+
+    static QSize bucket (const ISize &size);
+
+    QByteArray xml;
+    unsigned int generation;
+    int render_id;
+    QSize render_size;
+    unsigned int render_generation;
+    QSize wanted;
+    QSize shown_size;
+    unsigned int shown_generation;
+    QList <Raster> rasters;
+};
+
+/* Round up to steps of about 1/16th, so resizing doesn't render each pixel */
+QSize SvgRasterCache::bucket (const ISize &size) {
+    int w = qMax (1, size.width);
+    int h = qMax (1, size.height);
+    int wstep = qMax (8, (int) qNextPowerOfTwo ((quint32) w) / 16);
+    int hstep = qMax (8, (int) qNextPowerOfTwo ((quint32) h) / 16);
+    return QSize ((w + wstep - 1) / wstep * wstep,
+            (h + hstep - 1) / hstep * hstep);
+}
+
+const SvgRasterCache::Raster *SvgRasterCache::find (const QSize &size) {
+    for (int i = 0; i < rasters.size (); ++i)
+        if (rasters[i].generation == generation && rasters[i].size == size) {
+            if (i)
+                rasters.move (i, 0);
+            return &rasters.first ();
+        }
+    return nullptr;
+}
+
+const SvgRasterCache::Raster *SvgRasterCache::nearest (const QSize &size) const {
+    const Raster *best = nullptr;
+    qint64 best_diff = 0;
+    for (const Raster &r : rasters) {
+        qint64 diff = qAbs ((qint64) r.size.width () * r.size.height () -
+                (qint64) size.width () * size.height ());
+        if (r.generation != generation)
+            diff += Q_INT64_C (1) << 40; // any current one is better
+        if (!best || diff < best_diff) {
+            best = &r;
+            best_diff = diff;
+        }
+    }
+    return best;
+}
+
+void SvgRasterCache::insert (const QSize &size, unsigned int gen,
+        const QImage &img) {
+    Raster r;
+    r.size = size;
+    r.generation = gen;
+    r.image = img;
+    rasters.prepend (r);
+    // keep at most six rasters and 32 MiB
+    qint64 bytes = 0;
+    for (int i = 0; i < rasters.size (); ++i) {
+        bytes += rasters[i].image.sizeInBytes ();
+        if (i >= 6 || (i && bytes > 32 * 1024 * 1024)) {
+            rasters.erase (rasters.begin () + i, rasters.end ());
+            break;
+        }
+    }
+}
+
+//------------------------%<----------------------------------------------------
+
 ImageMedia::ImageMedia (MediaManager *manager, Node *node,
-        const QString &url, const QByteArray &ba)
- : MediaObject (manager, node), data (ba), buffer (nullptr),
-   img_movie (nullptr),
+        const QString &url, const QByteArray &ba, const QString &file)
+ : MediaObject (manager, node), data (ba), image_file (file),
    svg_renderer (nullptr),
+   svg_cache (nullptr),
+   frame_timer (nullptr),
+   frame_serial (0),
+   decode_id (0),
+   animating (false),
    update_render (false),
    paused (false) {
     setupImage (url);
@@ -1024,15 +2534,21 @@ ImageMedia::ImageMedia (MediaManager *manager, Node *node,
 ImageMedia::ImageMedia (Node *node, ImageDataPtr id)
  : MediaObject ((MediaManager *)node->document()->role (RoleMediaManager),
          node),
-   buffer (nullptr),
-   img_movie (nullptr),
    svg_renderer (nullptr),
-   update_render (false) {
+   svg_cache (nullptr),
+   frame_timer (nullptr),
+   frame_serial (0),
+   decode_id (0),
+   animating (false),
+   update_render (false),
+   paused (false) {
     if (!id) {
         Node *c = findChildWithId (node, id_node_svg);
         if (c) {
-            svg_renderer = new QSvgRenderer (c->outerXML().toUtf8 ());
+            QByteArray xml = c->outerXML().toUtf8 ();
+            svg_renderer = new QSvgRenderer (xml);
             if (svg_renderer->isValid ()) {
+                svg_cache = new SvgRasterCache (xml);
                 cached_img = new ImageData (QString ());
                 cached_img->flags = ImageData::ImageScalable;
                 if (svg_renderer->animated())
@@ -1049,31 +2565,48 @@ ImageMedia::ImageMedia (Node *node, ImageDataPtr id)
 }
 
 ImageMedia::~ImageMedia () {
-    delete img_movie;
+    cancelDecode ();
+    cancelFrameTimer ();
     delete svg_renderer;
-    delete buffer;
+    delete svg_cache;
 }
 
 bool ImageMedia::play () {
-    if (!img_movie)
+    if (!decode_id && isEmpty () && (data.size () || !image_file.isEmpty ()))
+        setupImage (image_url); // decoding was cancelled by stop ()
+    if (!animation)
         return false;
-    if (img_movie->state () == QMovie::Paused)
-        img_movie->setPaused (false);
-    else if (img_movie->state () != QMovie::Running)
-        img_movie->start ();
+    animation->rewind ();
+    animating = true;
+    if (!frame_timer)
+        frameTimer ();
     return true;
 }
 
 void ImageMedia::stop () {
+    cancelDecode ();
     pause ();
 }
 
+/* Drops a pending decode or SVG rasterisation, its result isn't needed */
+void ImageMedia::cancelDecode () {
+    if (!image_decoder)
+        return;
+    if (decode_id) {
+        image_decoder->cancel (decode_id);
+        decode_id = 0;
+    }
+    if (svg_cache && svg_cache->render_id) {
+        image_decoder->cancel (svg_cache->render_id);
+        svg_cache->render_id = 0;
+    }
+}
+
 void ImageMedia::pause () {
     if (!paused && svg_renderer && svg_renderer->animated())
         disconnect(svg_renderer, &QSvgRenderer::repaintNeeded,
                 this, &ImageMedia::svgUpdated);
-    if (img_movie && img_movie->state () != QMovie::Paused)
-        img_movie->setPaused (true);
+    cancelFrameTimer ();
     paused = true;
 }
 
@@ -1081,42 +2614,84 @@ void ImageMedia::unpause () {
     if (paused && svg_renderer && svg_renderer->animated())
         connect(svg_renderer, &QSvgRenderer::repaintNeeded,
                 this, &ImageMedia::svgUpdated);
-    if (img_movie && QMovie::Paused == img_movie->state ())
-        img_movie->setPaused (false);
+    if (animating && !frame_timer)
+        frameTimer ();
     paused = false;
 }
 
 void ImageMedia::setupImage (const QString &url) {
-    if (isEmpty () && data.size ()) {
-        QImage *pix = new QImage;
-        if (pix->loadFromData((data))) {
-            cached_img = ImageDataPtr (new ImageData (url));
-            cached_img->setImage (pix);
+    image_url = url;
+    if (isEmpty () && (data.size () || !image_file.isEmpty ())) {
+        animation = animated_images->value (url);
+        if (animation) {
+            cached_img = animation->frame;
+            setupDecoded (url);
+        } else if (!image_file.isEmpty ()) {
+            decode_id = image_decoder->decodeFile (this, url, image_file);
         } else {
-            delete pix;
+            decode_id = image_decoder->decode (this, url, data);
         }
+    } else {
+        setupDecoded (url);
     }
-    if (!isEmpty ()) {
-        buffer = new QBuffer (&data);
-        img_movie = new QMovie (buffer);
-        //qCDebug(LOG_KMPLAYER_COMMON) << img_movie->frameCount ();
-        if (img_movie->frameCount () > 1) {
-            cached_img->flags |= (short)ImageData::ImagePixmap | ImageData::ImageAnimated;
-            connect (img_movie, &QMovie::updated,
-                    this, &ImageMedia::movieUpdated);
-            connect (img_movie, &QMovie::stateChanged,
-                    this, &ImageMedia::movieStatus);
-            connect (img_movie, &QMovie::resized,
-                    this, &ImageMedia::movieResize);
+}
+
+void ImageMedia::imageDecoded (const QString &url, const QImage &img,
+        bool animated, const QByteArray &file_data) {
+    decode_id = 0;
+    if (!img.isNull ()) {
+        if (animated) {
+            animation = animated_images->value (url);
+            if (!animation) {
+                animation = new AnimatedImage (url,
+                        file_data.size () ? file_data : data, img);
+                animated_images->insert (url, animation);
+            }
+            cached_img = animation->frame;
         } else {
-            delete img_movie;
-            img_movie = nullptr;
-            delete buffer;
-            buffer = nullptr;
-            frame_nr = 0;
-            cached_img->flags |= (short)ImageData::ImagePixmap;
-            image_data_map->insert (url, ImageDataPtrW (cached_img));
+            cached_img = ImageDataPtr (new ImageData (url));
+            cached_img->setImage (new QImage (img));
         }
+        setupDecoded (url);
+    }
+    if (m_node)
+        m_node->document ()->post (m_node, new Posting (m_node, MsgMediaReady));
+}
+
+void ImageMedia::setupDecoded (const QString &url) {
+    if (isEmpty ())
+        return;
+    if (animation) {
+        data = QByteArray (); // the animation keeps its own reference
+        frame_serial = animation->serial;
+    } else {
+        cached_img->flags |= (short)ImageData::ImagePixmap;
+        image_data_map->insert (url, ImageDataPtrW (cached_img));
+        image_cache->retain (cached_img, url);
+    }
+}
+
+void ImageMedia::cancelFrameTimer () {
+    if (frame_timer && m_node)
+        m_node->document ()->cancelPosting (frame_timer);
+    frame_timer = nullptr;
+}
+
+void ImageMedia::frameTimer () {
+    frame_timer = nullptr;
+    if (!animation || !m_node)
+        return;
+    int ms = animation->advance ();
+    if (frame_serial != animation->serial) {
+        frame_serial = animation->serial;
+        m_node->document ()->post (m_node, new Posting (m_node, MsgMediaUpdated));
+    }
+    if (ms < 0) {
+        animating = false;
+        m_node->document ()->post (m_node, new Posting (m_node, MsgMediaFinished));
+    } else {
+        frame_timer = m_node->document ()->post (m_node,
+                new TimerPosting (ms, frame_timer_id));
     }
 }
 
@@ -1126,26 +2701,86 @@ void ImageMedia::render (const ISize &sz) {
         svg_renderer = nullptr;
         Node *c = findChildWithId (m_node, id_node_svg);
         if (c) {
-            QSvgRenderer *r = new QSvgRenderer (c->outerXML().toUtf8 ());
+            QByteArray xml = c->outerXML().toUtf8 ();
+            QSvgRenderer *r = new QSvgRenderer (xml);
             if (r->isValid ()) {
-                cached_img->setImage (nullptr);
+                if (r->animated () || !svg_cache)
+                    cached_img->setImage (nullptr);
                 svg_renderer = r;
+                if (svg_cache) {
+                    svg_cache->xml = xml;
+                    svg_cache->generation++;
+                }
             } else {
                 delete r;
             }
         }
         update_render = false;
     }
-    if (svg_renderer &&
-           (cached_img->width != sz.width || cached_img->height != sz.height)) {
-        QImage *img = new QImage (sz.width, sz.height,
-                QImage::Format_ARGB32_Premultiplied);
-        img->fill (0x0);
-        QPainter paint (img);
-        paint.setViewport (QRect (0, 0, sz.width, sz.height));
-        svg_renderer->render (&paint);
-        cached_img->setImage (img);
+    if (!svg_renderer || sz.width <= 0 || sz.height <= 0)
+        return;
+    if (!svg_cache || svg_renderer->animated ()) {
+        // animation state lives in svg_renderer, render it here
+        if (cached_img->width != sz.width || cached_img->height != sz.height ||
+                cached_img->isEmpty ()) {
+            QImage *img = new QImage (sz.width, sz.height,
+                    QImage::Format_ARGB32_Premultiplied);
+            img->fill (0x0);
+            QPainter paint (img);
+            paint.setViewport (QRect (0, 0, sz.width, sz.height));
+            svg_renderer->render (&paint);
+            cached_img->setImage (img);
+        }
+        return;
     }
+    QSize size = SvgRasterCache::bucket (sz);
+    const SvgRasterCache::Raster *r = svg_cache->find (size);
+    if (!r) {
+        r = svg_cache->nearest (size);
+        if (r) {
+            requestRaster (size);
+        } else { // nothing to show yet
+            QImage img (size, QImage::Format_ARGB32_Premultiplied);
+            img.fill (0x0);
+            QPainter paint (&img);
+            paint.setViewport (QRect (QPoint (), size));
+            svg_renderer->render (&paint);
+            paint.end ();
+            svg_cache->insert (size, svg_cache->generation, img);
+            r = svg_cache->find (size);
+        }
+    }
+    if (cached_img->isEmpty () ||
+            svg_cache->shown_size != r->size ||
+            svg_cache->shown_generation != r->generation) {
+        svg_cache->shown_size = r->size;
+        svg_cache->shown_generation = r->generation;
+        cached_img->setImage (new QImage (r->image));
+    }
+}
+
+void ImageMedia::requestRaster (const QSize &size) {
+    svg_cache->wanted = size;
+    if (svg_cache->render_id) {
+        if (svg_cache->render_size == size &&
+                svg_cache->render_generation == svg_cache->generation)
+            return;
+        // stale, for another size or an older parse of the SVG
+        image_decoder->cancel (svg_cache->render_id);
+    }
+    svg_cache->render_size = size;
+    svg_cache->render_generation = svg_cache->generation;
+    svg_cache->render_id = image_decoder->render (this, svg_cache->xml, size);
+}
+
+void ImageMedia::svgRendered (const QImage &img) {
+    svg_cache->render_id = 0;
+    svg_cache->insert (svg_cache->render_size,
+            svg_cache->render_generation, img);
+    if (m_node)
+        m_node->document ()->post (m_node, new Posting (m_node, MsgMediaUpdated));
+    if (!svg_cache->find (svg_cache->wanted))
+        requestRaster (svg_cache->wanted);
 }
 
 void ImageMedia::updateRender () {
@@ -1178,29 +2813,6 @@ void ImageMedia::svgUpdated() {
         m_node->document ()->post (m_node, new Posting (m_node, MsgMediaUpdated));
 }
 
-void ImageMedia::movieResize (const QSize &) {
-    //qCDebug(LOG_KMPLAYER_COMMON) << "movieResize" << endl;
-    if (m_node)
-        m_node->document ()->post (m_node, new Posting (m_node, MsgMediaUpdated));
-}
-
-void ImageMedia::movieUpdated (const QRect &) {
-    if (frame_nr++) {
-        Q_ASSERT (cached_img && isEmpty ());
-        QImage *img = new QImage;
-        *img = img_movie->currentImage ();
-        cached_img->setImage (img);
-        cached_img->flags = (int)(ImageData::ImagePixmap | ImageData::ImageAnimated); //TODO
-        if (m_node)
-            m_node->document ()->post (m_node, new Posting (m_node, MsgMediaUpdated));
-    }
-}
-
-void ImageMedia::movieStatus (QMovie::MovieState status) {
-    if (QMovie::NotRunning == status && m_node)
-        m_node->document ()->post (m_node, new Posting (m_node, MsgMediaFinished));
-}
-
 //------------------------%<----------------------------------------------------
 
 static int default_font_size = -1;
@@ -1208,8 +2820,8 @@ static int default_font_size = -1;
 TextMedia::TextMedia (MediaManager *manager, Node *node, const QByteArray &ba)
  : MediaObject (manager, node) {
     QByteArray data (ba);
-    if (!data [data.size () - 1])
-        data.resize (data.size () - 1); // strip zero terminate char
+    if (data.size () && !data.at (data.size () - 1)) // zero terminate char
+        data = QByteArray::fromRawData (ba.constData (), ba.size () - 1);
     QTextStream ts (data, QIODevice::ReadOnly);
     QString val = convertNode <Element> (node)->getAttribute ("charset");
     if (!val.isEmpty ()) {
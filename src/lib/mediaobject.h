@@ -14,13 +14,17 @@
 #include <QPair>
 #include <QMap>
 #include <QString>
-#include <QMovie>
+#include <QStringList>
 #include <QList>
+#include <QCache>
+#include <QPointer>
+#include <QUrl>
+#include <QRegExp>
 
 #include "kmplayercommon_export.h"
 #include "kmplayerplaylist.h"
+#include "chunkbuffer.h"
 
-class QMovie;
 class QImage;
 class QSvgRenderer;
 class QBuffer;
@@ -142,6 +146,11 @@ public:
     ProcessList &recorders () { return m_recorders; }
     MediaList &medias () { return m_media_objects; }
     PartBase *player () const { return m_player; }
+    void setPrefetchBudget (int kbytes, int jobs);
+    void setImageCacheBudget (int kbytes);
+    void setMemoryCacheBudget (int kbytes);
+    void setDiskCacheBudget (int kbytes);
+    void setDownloadLimits (int jobs, int host_jobs);
 
 private:
     MediaList m_media_objects;
@@ -156,28 +165,131 @@ private:
 //------------------------%<----------------------------------------------------
 
 /*
- * Abstract base of MediaObject types, handles downloading
+ * Disk tier below DataCache. Files named after the SHA-1 of their content,
+ * with an index of url, mime, HTTP validators and expiry, in the XDG cache
+ * dir. Expired entries are only returned when asked for a stale copy, hits
+ * without an expiry are revalidated in the background with a conditional GET.
  */
+class DiskCache : public QObject
+{
+    Q_OBJECT
+    friend class FetchScheduler;
+    struct Entry {
+        QString hash;
+        QString mime;
+        QString etag;
+        QString last_modified;
+        qint64 size;
+        qint64 used;    // seconds since epoch
+        qint64 expires; // seconds since epoch, 0 unknown, -1 always stale
+    };
+    typedef QMap <QString, Entry> EntryMap;
+public:
+    DiskCache (QObject *parent);
+    ~DiskCache () override;
 
+    static bool cacheable (const QString &url);
+
+    void setBudget (int kbytes);
+    bool get (const QString &url, QString &mime, QByteArray &data,
+            qint64 &expires, bool allow_stale=false);
+    void store (const QString &url, const QString &mime,
+            const QByteArray &data, const QString &http_headers);
+    void revalidate (const QString &url);
+Q_SIGNALS:
+    void updated (const QString &url, const QString &mime,
+            const QByteArray &data, qint64 expires);
+private Q_SLOTS:
+    void revalidateData (KIO::Job *, const QByteArray &qb);
+    void revalidateResult (KJob *);
+    void saveIndex ();
+private:
+    void load ();
+    void remove (EntryMap::iterator it);
+    void evict ();
+    void scheduleSave ();
+    KJob *startRevalidation (const QUrl &url);
+
+    struct Revalidation {
+        QString url;
+        QByteArray data;
+    };
+    QMap <KJob *, Revalidation> revalidations;
+    QStringList revalidations_queued;   // waiting in the FetchScheduler
+    EntryMap entries;
+    QString path;
+    qint64 budget;
+    qint64 bytes;
+    bool loaded;
+    bool save_pending;
+};
+
+class MediaInfo;
+
+/*
+ * Downloaded data by url, evicted least recently used first when over
+ * budget. Data still shared with a MediaInfo, or pinned by an active
+ * document, is never evicted.
+ * Also the table of downloads in flight, one per url, delivering the
+ * result directly to the MediaInfo's waiting for that url.
+ * Expired data is only handed out when its download failed.
+ */
 class DataCache : public QObject
 {
     Q_OBJECT
-    typedef QMap <QString, QPair <QString, QByteArray> > DataMap;
-    typedef QMap <QString, bool> PreserveMap;
+    struct Entry {
+        QString mime;
+        QByteArray data;
+        unsigned int used;          // stamp of last add or get
+        qint64 expires;             // as DiskCache::Entry::expires
+        QList <NodePtrW> pinned_by; // media nodes using it
+    };
+    typedef QMap <QString, Entry> DataMap;
+    struct Fetch {
+        MediaInfo *owner;           // the one downloading
+        QList <QPointer <MediaInfo> > waiters;
+    };
+    typedef QMap <QString, Fetch> FetchMap;
     DataMap cache_map;
-    PreserveMap preserve_map;
+    FetchMap in_flight;
+    qint64 budget;
+    qint64 bytes;
+    unsigned int stamp;
+    DiskCache *disk;
+
+    void insert (const QString &url, const QString &mime,
+            const QByteArray &data, qint64 expires);
+    bool evictable (Entry &entry);
+    void evict ();
 public:
-    DataCache () {}
+    DataCache ();
     ~DataCache () override {}
-    void add (const QString &, const QString &, const QByteArray &);
-    bool get (const QString &, QString &, QByteArray &);
-    bool preserve (const QString &);
-    bool unpreserve (const QString &);
-    bool isPreserved (const QString &);
-Q_SIGNALS:
-    void preserveRemoved (const QString &); // ready or canceled
+    void setBudget (int kbytes);
+    void setDiskBudget (int kbytes);
+    void add (const QString &, const QString &, const QByteArray &,
+            const QString &http_headers=QString ());
+    bool get (const QString &, QString &, QByteArray &, bool allow_stale=false);
+    void pin (const QString &url, Node *node);
+    void unpin (const QString &url, Node *node);
+    bool fetch (const QString &url, MediaInfo *mi);
+    MediaInfo *cancel (const QString &url, MediaInfo *mi);
+    void failed (const QString &url, const QString &stale_mime=QString (),
+            const QByteArray &stale_data=QByteArray ());
+    qint64 residentBytes () const { return bytes; }
+
+    int hits;
+    int misses;
+    int disk_hits;
+    int evictions;
+private Q_SLOTS:
+    void diskUpdated (const QString &url, const QString &mime,
+            const QByteArray &data, qint64 expires);
 };
 
+/*
+ * Abstract base of MediaObject types, handles downloading
+ */
+
 class KMPLAYERCOMMON_EXPORT MediaObject : public QObject
 {
     Q_OBJECT
@@ -203,18 +315,117 @@ protected:
 
 //------------------------%<----------------------------------------------------
 
+class MediaInfo;
+
+/*
+ * Downloads of MediaInfo's ahead of their node's begin time, started in
+ * request order while the number of running jobs and the bytes held by
+ * not yet begun nodes stay within budget
+ */
+class PrefetchScheduler
+{
+public:
+    PrefetchScheduler ();
+
+    void setBudget (int bytes, int jobs);
+    void request (MediaInfo *mi);
+    void release (MediaInfo *mi);
+    void update ();
+
+private:
+    QList <MediaInfo *> pending;
+    QList <MediaInfo *> fetched;   // downloading or ready, but not begun yet
+    int max_bytes;
+    int max_jobs;
+};
+
+/*
+ * Starts the downloads of MediaInfo's, those of begun nodes first, then
+ * prefetches and disk cache revalidations, and last thumbnails of feeds,
+ * while the running jobs per host and in total stay within limits.
+ * Speculative ones leave one job free.
+ */
+class FetchScheduler
+{
+public:
+    enum Priority { Active, Prefetch, Thumbnail };
+
+    FetchScheduler ();
+
+    void setLimits (int jobs, int host_jobs);
+    void request (MediaInfo *mi, const QUrl &url);
+    void revalidate (DiskCache *cache, const QUrl &url);
+    void cancel (MediaInfo *mi);
+    void cancel (DiskCache *cache);
+    void replace (MediaInfo *mi, MediaInfo *with);
+    void raise (const QString &url, Priority priority);
+    void finished (KJob *job);
+
+private:
+    struct Request {
+        MediaInfo *mi;      // either mi downloads
+        DiskCache *cache;   // or cache revalidates url
+        QUrl url;
+    };
+    void update ();
+
+    QList <Request> queued [Thumbnail + 1];
+    QMap <KJob *, QString> running; // hosts of started jobs
+    QMap <QString, int> host_jobs;
+    int max_jobs;
+    int max_host_jobs;
+};
+
+/*
+ * Cross-domain policies by policy url, with the decisions per requesting
+ * domain, kept for a while. Only one MediaInfo downloads a policy, the
+ * others asking meanwhile get the decision when it's in.
+ */
+class CrossDomainPolicies
+{
+public:
+    enum Access { Allowed, Denied, Unknown, Waiting };
+
+    Access check (const QString &policy_url, const QString &domain, MediaInfo *mi);
+    bool allows (const QString &policy_url, const QString &domain);
+    void done (const QString &policy_url, const QByteArray &xml, bool failed);
+    void cancel (const QString &policy_url, MediaInfo *mi);
+
+private:
+    struct Policy {
+        QList <QRegExp> allow;
+        QMap <QString, bool> decisions;
+        qint64 expires;
+    };
+    struct Fetch {
+        MediaInfo *owner;
+        QList <QPointer <MediaInfo> > waiters;
+    };
+    QMap <QString, Policy> policies;
+    QMap <QString, Fetch> in_flight;
+};
+
 class KMPLAYERCOMMON_EXPORT MediaInfo : public QObject
 {
     Q_OBJECT
+    friend class PrefetchScheduler;
+    friend class FetchScheduler;
+    friend class CrossDomainPolicies;
+    friend class DataCache;
 public:
     MediaInfo (Node *node, MediaManager::MediaType type);
     ~MediaInfo () override;
 
     bool wget(const QString& url, const QString& from_domain=QString());
+    void prefetch(const QString& url,
+            FetchScheduler::Priority priority=FetchScheduler::Prefetch) KMPLAYERCOMMON_NO_EXPORT;
+    void setThumbnail (bool b) { thumbnail = b; }
+    void claim() KMPLAYERCOMMON_NO_EXPORT;
     void killWGet() KMPLAYERCOMMON_NO_EXPORT;
     void clearData() KMPLAYERCOMMON_NO_EXPORT;
     QString mimetype() KMPLAYERCOMMON_NO_EXPORT;
     bool downloading() const KMPLAYERCOMMON_NO_EXPORT;
+    bool prefetching() const { return PrefetchNone != prefetch_state; }
     void create ();
 
     QByteArray &rawData () { return data; }
@@ -228,19 +439,30 @@ private Q_SLOTS:
     void slotResult(KJob*) KMPLAYERCOMMON_NO_EXPORT;
     void slotData(KIO::Job*, const QByteArray& qb) KMPLAYERCOMMON_NO_EXPORT;
     void slotMimetype (KIO::Job* job, const QString& mimestr) KMPLAYERCOMMON_NO_EXPORT;
-    void cachePreserveRemoved(const QString&) KMPLAYERCOMMON_NO_EXPORT;
 
 private:
+    void fetchDone(const QString& mime, const QByteArray& data) KMPLAYERCOMMON_NO_EXPORT;
+    void fetchFailed() KMPLAYERCOMMON_NO_EXPORT;
+    void takeOver(MediaInfo *owner) KMPLAYERCOMMON_NO_EXPORT;
+    void startJob(const QUrl& url) KMPLAYERCOMMON_NO_EXPORT;
+    void accessChecked(bool allowed) KMPLAYERCOMMON_NO_EXPORT;
     void ready() KMPLAYERCOMMON_NO_EXPORT;
+    FetchScheduler::Priority activePriority() const KMPLAYERCOMMON_NO_EXPORT;
     bool readChildDoc() KMPLAYERCOMMON_NO_EXPORT;
     void setMimetype(const QString&) KMPLAYERCOMMON_NO_EXPORT;
 
     Node *node;
     KIO::TransferJob *job;
+    ChunkBuffer received;   // data while downloading
     QString cross_domain;
     QString access_from;
-    bool preserve_wait;
+    bool inflight_wait;
     bool check_access;
+    bool fetch_queued;
+    bool policy_wait;
+    bool thumbnail;         // fetched after everything else, even when shown
+    FetchScheduler::Priority fetch_priority;
+    enum { PrefetchNone, PrefetchQueued, PrefetchStarted } prefetch_state;
 };
 
 //------------------------%<----------------------------------------------------
@@ -321,6 +543,8 @@ protected:
  * MediaObject for (animated)images
  */
 
+class ScaledImageCache;
+
 struct ImageData
 {
     enum ImageFlags {
@@ -330,15 +554,10 @@ struct ImageData
     ~ImageData();
     void setImage (QImage *img);
 #ifdef KMPLAYER_WITH_CAIRO
-    void copyImage (Surface *s, const SSize &sz, cairo_surface_t *similar, CalculatedSizer *zoom=nullptr);
+    void copyImage (Surface *s, const SSize &sz, cairo_surface_t *similar,
+            ScaledImageCache *cache, CalculatedSizer *zoom=nullptr);
 #endif
-    bool isEmpty () const {
-        return !image
-#ifdef KMPLAYER_WITH_CAIRO
-            && !surface
-#endif
-            ;
-    }
+    bool isEmpty () const { return !image; }
 
     unsigned short width;
     unsigned short height;
@@ -346,21 +565,53 @@ struct ImageData
     bool has_alpha;
 private:
     QImage *image;
-#ifdef KMPLAYER_WITH_CAIRO
-    cairo_surface_t *surface;
-#endif
     QString url;
 };
 
 typedef SharedPtr <ImageData> ImageDataPtr;
 typedef WeakPtr <ImageData> ImageDataPtrW;
 
+class AnimatedImage;
+typedef SharedPtr <AnimatedImage> AnimatedImagePtr;
+typedef WeakPtr <AnimatedImage> AnimatedImagePtrW;
+
+class SvgRasterCache;
+
+/*
+ * Decoded images kept alive after their last user went away, evicted least
+ * recently used first within a budget. Only holds images in main memory,
+ * device copies scaled from them are kept by each ViewArea.
+ */
+class ImageCache
+{
+public:
+    ImageCache ();
+    ~ImageCache ();
+
+    static ImageCache *instance ();
+
+    void setBudget (int kbytes);
+    void retain (ImageDataPtr img, const QString &url);
+    void touch (const QString &url);
+    ImageDataPtrW shared (const QString &url) const;
+    int residentKBytes () const { return cache.totalCost (); }
+
+    int hits;
+    int misses;
+
+private:
+    struct Entry {
+        ImageDataPtr decoded;
+    };
+    QCache <QString, Entry> cache;   // cost in KiB
+};
+
 class ImageMedia : public MediaObject
 {
     Q_OBJECT
 public:
-    ImageMedia (MediaManager *manager, Node *node,
-            const QString &url, const QByteArray &data);
+    ImageMedia (MediaManager *manager, Node *node, const QString &url,
+            const QByteArray &data, const QString &file=QString ());
     ImageMedia (Node *node, ImageDataPtr id = nullptr);
 
     MediaManager::MediaType type () const override { return MediaManager::Image; }
@@ -372,29 +623,43 @@ public:
 
     bool wget (const QString &url);
     bool isEmpty () const;
+    bool decoding () const { return decode_id; }
+    void cancelDecode ();
+    void imageDecoded (const QString &url, const QImage &img, bool animated,
+            const QByteArray &file_data);
+    void frameTimer ();
+    void svgRendered (const QImage &img);
     void render (const ISize &size);
     void sizes (SSize &size);
     void updateRender ();
 
     ImageDataPtr cached_img;
 
+    /* TimerPosting id of animation frame flips, posted to the media node */
+    static const unsigned int frame_timer_id = 8;
+
 private Q_SLOTS:
     void svgUpdated();
-    void movieUpdated (const QRect &);
-    void movieStatus (QMovie::MovieState);
-    void movieResize (const QSize &);
 
 protected:
     ~ImageMedia () override;
 
 private:
     void setupImage (const QString &url);
+    void setupDecoded (const QString &url);
+    void cancelFrameTimer ();
+    void requestRaster (const QSize &size);
 
     QByteArray data;
-    QBuffer *buffer;
-    QMovie *img_movie;
+    QString image_url;        // to decode again after stop ()
+    QString image_file;       // local file decoded without data
     QSvgRenderer *svg_renderer;
-    int frame_nr;
+    SvgRasterCache *svg_cache;
+    AnimatedImagePtr animation;
+    Posting *frame_timer;
+    unsigned int frame_serial;
+    int decode_id;
+    bool animating;
     bool update_render;
     bool paused;
 };
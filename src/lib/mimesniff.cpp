@@ -0,0 +1,95 @@
+/*
+    This file belong to the KMPlayer project, a movie player plugin for Konqueror
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include <ctype.h>
+#include <string.h>
+#include <strings.h>
+
+#include <QtGlobal>
+
+#include "mimesniff.h"
+
+/*
+ * Magic numbers of the formats we care about, so that the common cases need
+ * no QMimeDatabase lookup. Some also need a second pattern further on.
+ */
+struct ContentMagic {
+    const char *magic;
+    int length;
+    int offset2;
+    const char *magic2;
+    int length2;
+    const char *mime;
+};
+
+static const ContentMagic content_magic [] = {
+    { "\x89PNG\r\n\x1a\n", 8, 0, nullptr, 0, "image/png" },
+    { "\xff\xd8\xff", 3, 0, nullptr, 0, "image/jpeg" },
+    { "GIF87a", 6, 0, nullptr, 0, "image/gif" },
+    { "GIF89a", 6, 0, nullptr, 0, "image/gif" },
+    { "RIFF", 4, 8, "WEBP", 4, "image/webp" },
+    { "RIFF", 4, 8, "AVI ", 4, "video/x-msvideo" },
+    { "RIFF", 4, 8, "WAVE", 4, "audio/x-wav" },
+    { "\x30\x26\xb2\x75\x8e\x66\xcf\x11", 8, 0, nullptr, 0, "application/vnd.ms-asf" },
+    { "FLV\x01", 4, 0, nullptr, 0, "video/x-flv" },
+    { "\x00\x00\x01\xba", 4, 0, nullptr, 0, "video/mpeg" },
+    { "ID3", 3, 0, nullptr, 0, "audio/mpeg" },
+    { "fLaC", 4, 0, nullptr, 0, "audio/flac" },
+    { ".RMF", 4, 0, nullptr, 0, "application/vnd.rn-realmedia" },
+    { "FWS", 3, 0, nullptr, 0, "application/x-shockwave-flash" },
+    { "CWS", 3, 0, nullptr, 0, "application/x-shockwave-flash" },
+    { "#EXTM3U", 7, 0, nullptr, 0, "audio/x-mpegurl" }
+};
+
+/* Root elements of the XML playlists and images we read ourselves */
+static const char * const xml_roots [][2] = {
+    { "smil", "application/smil+xml" },
+    { "rss", "application/rss+xml" },
+    { "feed", "application/atom+xml" },
+    { "playlist", "application/xspf+xml" },
+    { "asx", "audio/x-ms-asx" },
+    { "svg", "image/svg+xml" }
+};
+
+const char *KMPlayer::sniffMime (const QByteArray &data)
+{
+    const char *p = data.constData ();
+    const int size = data.size ();
+    for (const ContentMagic &m : content_magic)
+        if (size >= m.length && !memcmp (p, m.magic, m.length) &&
+                (!m.magic2 || (size >= m.offset2 + m.length2 &&
+                    !memcmp (p + m.offset2, m.magic2, m.length2))))
+            return m.mime;
+
+    const int end = qMin (size, 1024);
+    int i = size >= 3 && !memcmp (p, "\xef\xbb\xbf", 3) ? 3 : 0; // BOM
+    while (i < end) {
+        while (i < end && (p[i] == ' ' || p[i] == '\t' ||
+                    p[i] == '\r' || p[i] == '\n'))
+            ++i;
+        if (end - i >= 10 && !strncasecmp (p + i, "[playlist]", 10))
+            return "audio/x-scpls";
+        if (end - i < 2 || p[i] != '<')
+            break;
+        if (p[i + 1] == '?' || p[i + 1] == '!') { // prolog, doctype, comment
+            const bool comment = end - i >= 4 && !strncmp (p + i, "<!--", 4);
+            for (i += 2; i < end; ++i)
+                if (p[i] == '>' && (!comment || !strncmp (p + i - 2, "--", 2)))
+                    break;
+            ++i;
+            continue;
+        }
+        for (unsigned r = 0; r < sizeof (xml_roots) / sizeof (xml_roots[0]); ++r) {
+            const int len = strlen (xml_roots[r][0]);
+            if (end - i > len + 1 &&
+                    !strncasecmp (p + i + 1, xml_roots[r][0], len) &&
+                    !isalnum ((unsigned char) p[i + 1 + len]))
+                return xml_roots[r][1];
+        }
+        break;
+    }
+    return nullptr;
+}
@@ -0,0 +1,22 @@
+/*
+    This file belong to the KMPlayer project, a movie player plugin for Konqueror
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#ifndef _KMPLAYER_MIMESNIFF_H_
+#define _KMPLAYER_MIMESNIFF_H_
+
+#include <QByteArray>
+
+namespace KMPlayer {
+
+/*
+ * Mimetype of data by the magic of its first bytes, for the formats we
+ * care about, or nullptr when not one of these.
+ */
+const char *sniffMime (const QByteArray &data);
+
+}
+
+#endif
@@ -0,0 +1,127 @@
+/*
+    This file belong to the KMPlayer project, a movie player plugin for Konqueror
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#include <ctype.h>
+#include <string.h>
+
+#include <QByteArray>
+
+#include "mplayeroutput.h"
+
+using namespace KMPlayer;
+
+static const struct MPlayerPrefix {
+    const char *prefix;
+    int length;
+    MPlayerLine line;
+} mplayer_prefixes [] = {
+    { "ID_LENGTH", 9, LineLength },
+    { "ID_PAUSED", 9, LinePaused },
+    { "ID_VIDEO_WIDTH", 14, LineVideoWidth },
+    { "ID_VIDEO_HEIGHT", 15, LineVideoHeight },
+    { "ID_VIDEO_ASPECT", 15, LineVideoAspect },
+    { "ID_AID_", 7, LineAudioLang },
+    { "ID_SID_", 7, LineSubtitleLang },
+    { "ICY Info", 8, LineIcyInfo }
+};
+
+bool KMPlayer::mplayerLine (const char *line, int len, MPlayerLine &kind,
+        const char *&value) {
+    value = nullptr;
+    if (len <= 0 || line[0] != 'I')
+        return false;
+    for (const MPlayerPrefix &p : mplayer_prefixes)
+        if (len >= p.length && !memcmp (line, p.prefix, p.length)) {
+            kind = p.line;
+            value = (const char *) memchr (line, '=', len);
+            if (value)
+                ++value;
+            return true;
+        }
+    return false;
+}
+
+bool KMPlayer::parseNumber (const char *s, const char *end, double &value,
+        bool comma) {
+    while (s < end && isspace ((unsigned char) *s))
+        ++s;
+    while (end > s && isspace ((unsigned char) end[-1]))
+        --end;
+    const char *start = s;
+    bool negative = s < end && *s == '-';
+    if (s < end && (*s == '-' || *s == '+'))
+        ++s;
+    double v = 0.0;
+    double scale = 0.0;
+    bool digits = false;
+    for (; s < end; ++s) {
+        if (*s >= '0' && *s <= '9') {
+            digits = true;
+            if (scale > 0.0) {
+                scale *= 0.1;
+                v += scale * (*s - '0');
+            } else {
+                v = 10.0 * v + (*s - '0');
+            }
+        } else if ((*s == '.' || (comma && *s == ',')) && scale == 0.0) {
+            scale = 1.0;
+        } else if ((*s == 'e' || *s == 'E') && digits) {
+            // rare, eg. ID_LENGTH=1e+03, leave those to QByteArray
+            QByteArray num (start, end - start);
+            if (comma)
+                num.replace (',', '.');
+            bool ok;
+            const double d = num.toDouble (&ok);
+            if (ok)
+                value = d;
+            return ok;
+        } else {
+            return false;
+        }
+    }
+    value = negative ? -v : v;
+    return digits;
+}
+
+int KMPlayer::parseInt (const char *s, const char *end) {
+    double v;
+    return parseNumber (s, end, v) && v == (int) v ? (int) v : 0;
+}
+
+bool KMPlayer::statusPosition (const char *s, int len, double &pos) {
+    for (int i = 0; i + 1 < len; ++i)
+        if ((s[i] == 'A' || s[i] == 'V') && s[i + 1] == ':') {
+            int j = i + 2;
+            while (j < len && isspace ((unsigned char) s[j]))
+                ++j;
+            int k = j;
+            while (k < len && ((s[k] >= '0' && s[k] <= '9') || s[k] == '.'))
+                ++k;
+            if (k > j) {
+                if (!parseNumber (s + j, s + k, pos))
+                    pos = 0.0;
+                return true;
+            }
+        }
+    return false;
+}
+
+bool KMPlayer::statusCacheFill (const char *s, int len, double &fill) {
+    const QByteArray line = QByteArray::fromRawData (s, len);
+    int i = line.indexOf ("Cache fill:");
+    if (i < 0)
+        return false;
+    for (i += 11; i < len && !(s[i] >= '0' && s[i] <= '9'); ++i)
+        ;
+    int k = i;
+    while (k < len && ((s[k] >= '0' && s[k] <= '9') || s[k] == '.'))
+        ++k;
+    if (k == i || k >= len || s[k] != '%')
+        return false;
+    if (!parseNumber (s + i, s + k, fill))
+        fill = 0.0;
+    return true;
+}
@@ -0,0 +1,39 @@
+/*
+    This file belong to the KMPlayer project, a movie player plugin for Konqueror
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#ifndef _KMPLAYER_MPLAYEROUTPUT_H_
+#define _KMPLAYER_MPLAYEROUTPUT_H_
+
+namespace KMPlayer {
+
+/*
+ * MPlayer output lines we recognize by their prefix, before trying the
+ * configurable patterns
+ */
+enum MPlayerLine {
+    LineLength, LinePaused, LineVideoWidth, LineVideoHeight, LineVideoAspect,
+    LineAudioLang, LineSubtitleLang, LineIcyInfo
+};
+
+/* Kind of line, value points past its '=' or is nullptr without one */
+bool mplayerLine (const char *line, int len, MPlayerLine &kind,
+        const char *&value);
+
+/* Like QString::toDouble, but on bytes, allowing a decimal comma if asked */
+bool parseNumber (const char *s, const char *end, double &value,
+        bool comma=false);
+
+int parseInt (const char *s, const char *end);
+
+/* The default position pattern "[AV]:\s*([0-9\.]+)" */
+bool statusPosition (const char *s, int len, double &pos);
+
+/* The default cache pattern "Cache fill:[^0-9]*([0-9\.]+)%" */
+bool statusCacheFill (const char *s, int len, double &fill);
+
+}
+
+#endif
@@ -29,8 +29,13 @@ Surface::Surface (ViewArea *widget)
     background_color (0),
 #ifdef KMPLAYER_WITH_CAIRO
     surface (nullptr),
+    layer (nullptr),
 #endif
+    painted_frame (0),
+    z_ordered (false),
     dirty (false),
+    layer_stale (true),
+    has_video (false),
     scroll (false),
     has_mouse (false),
     view_widget (widget)
@@ -40,24 +45,35 @@ Surface::~Surface() {
 #ifdef KMPLAYER_WITH_CAIRO
     if (surface)
         cairo_surface_destroy (surface);
+    if (layer)
+        cairo_surface_destroy (layer);
 #endif
 }
 
 template <> void TreeNode<Surface>::appendChild (Surface *c) {
     appendChildImpl (c);
+    static_cast <Surface *> (this)->boundsChanged ();
 }
 
 template <> void TreeNode<Surface>::insertBefore (Surface *c, Surface *b) {
     insertBeforeImpl (c, b);
+    static_cast <Surface *> (this)->boundsChanged ();
 }
 
 template <> void TreeNode<Surface>::removeChild (SurfacePtr c) {
+    if (c->z_ordered) {
+        static_cast <Surface *> (this)->z_children.remove (c->z_order);
+        c->z_ordered = false;
+    }
     removeChildImpl (c);
+    static_cast <Surface *> (this)->boundsChanged ();
 }
 
 void Surface::clear () {
+    z_children.clear ();
     m_first_child = nullptr;
     background_color = 0;
+    boundsChanged ();
 }
 
 void Surface::remove () {
@@ -66,13 +82,28 @@ void Surface::remove () {
         sp->markDirty ();
         sp->removeChild (this);
     }
+    releaseLayers ();
+}
+
+/**
+ * Drop the retained layers of this hidden subtree
+ */
+void Surface::releaseLayers () {
+#ifdef KMPLAYER_WITH_CAIRO
+    if (layer) {
+        cairo_surface_destroy (layer);
+        layer = nullptr;
+    }
+    for (Surface *c = firstChild (); c; c = c->nextSibling ())
+        c->releaseLayers ();
+#endif
 }
 
 void Surface::resize (const SRect &rect, bool parent_resized) {
     SRect old_bounds = bounds;
     bounds = rect;
     if (parent_resized || old_bounds != rect) {
-
+        boundsChanged ();
         if (parent_resized || old_bounds.size != rect.size) {
             virtual_size = SSize (); //FIXME try to preserve scroll on resize
             markDirty ();
@@ -94,10 +125,27 @@ void Surface::resize (const SRect &rect, bool parent_resized) {
 }
 
 void Surface::markDirty () {
+    invalidate ();
+    boundsChanged ();
     for (Surface *s = this; s && !s->dirty; s = s->parentNode ())
         s->dirty = true;
 }
 
+/**
+ * Lets the view know that pointer targets may have moved
+ */
+void Surface::boundsChanged () {
+    view_widget->surfacesChanged ();
+}
+
+/**
+ * Only flags, a layer may be the paint target while this is called
+ */
+void Surface::invalidate () {
+    for (Surface *s = this; s; s = s->parentNode ())
+        s->layer_stale = true;
+}
+
 void Surface::updateChildren (bool parent_resized) {
     for (Surface *c = firstChild (); c; c = c->nextSibling ())
         if (c->node)
@@ -125,6 +173,33 @@ IRect Surface::toScreen (const SSize &size) {
     return matrix.toScreen (SRect (0, 0, size));
 }
 
+/**
+ * Stacked children come first in the child list, bottom one first, so a
+ * lookup in the parent's z_children gives the new position
+ */
+void Surface::setZOrder (const ZOrder &zorder) {
+    Surface *ps = parentNode ();
+    if (ps && z_ordered)
+        ps->z_children.remove (z_order);
+    z_order = zorder;
+    z_ordered = !!ps;
+    if (!ps)
+        return;
+    SurfacePtr protect (this);
+    ps->removeChildImpl (protect);
+    ZOrderMap::iterator it = ps->z_children.insert (z_order, m_self);
+    ZOrderMap::iterator next = it;
+    Surface *before;
+    if (++next != ps->z_children.end ())
+        before = next.value ().ptr ();
+    else if (it != ps->z_children.begin ())
+        before = (--it).value ()->nextSibling ();
+    else
+        before = ps->firstChild ();
+    ps->insertBeforeImpl (this, before);
+    ps->boundsChanged ();
+}
+
 void Surface::setBackgroundColor (unsigned int argb) {
 #ifdef KMPLAYER_WITH_CAIRO
     if (surface &&
@@ -157,6 +232,7 @@ static void clipToScreen (Surface *s, Matrix &m, IRect &clip) {
 
 
 void Surface::repaint (const SRect &rect) {
+    invalidate ();
     Matrix matrix;
     IRect clip;
     clipToScreen (this, matrix, clip);
@@ -167,6 +243,7 @@ void Surface::repaint (const SRect &rect) {
 }
 
 void Surface::repaint () {
+    layer_stale = true;
     Surface *ps = parentNode ();
     if (ps)
         ps->repaint (bounds);
@@ -10,6 +10,8 @@
 
 #include <config-kmplayer.h>
 
+#include <QMap>
+
 #include "kmplayerplaylist.h"
 
 #ifdef KMPLAYER_WITH_CAIRO
@@ -23,6 +25,21 @@ class ViewArea;
 class Surface : public TreeNode <Surface>
 {
 public:
+    /*
+     * Stacking of a child, z-index first and document order for equal ones
+     */
+    struct ZOrder {
+        ZOrder () : z_index (0), order (0) {}
+        ZOrder (int z, unsigned int o) : z_index (z), order (o) {}
+        bool operator < (const ZOrder &o) const {
+            return z_index < o.z_index ||
+                (z_index == o.z_index && order < o.order);
+        }
+        int z_index;
+        unsigned int order;
+    };
+    typedef QMap <ZOrder, WeakPtr <Surface> > ZOrderMap;
+
     Surface (ViewArea *widget);
     ~Surface();
 
@@ -34,8 +51,12 @@ public:
     void repaint (const SRect &rect);
     void remove ();                // remove from parent, mark ancestors dirty
     void markDirty ();             // mark this and ancestors dirty
+    void invalidate ();            // retained layers of this and ancestors are stale
+    void releaseLayers ();         // free retained layers of this subtree
+    void boundsChanged ();         // geometry or children of this subtree changed
     void updateChildren (bool parent_resized=false);
     void setBackgroundColor (unsigned int argb);
+    void setZOrder (const ZOrder &zorder); // (re)sort in parent's z_children
 
     NodePtrW node;
     SRect bounds;                  // bounds in parent coord.
@@ -46,8 +67,16 @@ public:
     unsigned short y_scroll;       // top of vertical knob
 #ifdef KMPLAYER_WITH_CAIRO
     cairo_surface_t *surface;
+    cairo_surface_t *layer;        // retained rendering of a region and its children
 #endif
+    ISize layer_size;
+    unsigned int painted_frame;    // frame the content was last painted in
+    ZOrderMap z_children;          // stacked children, bottom first
+    ZOrder z_order;
+    bool z_ordered;                // in parent's z_children, before others
     bool dirty;                    // a decendant is removed
+    bool layer_stale;              // content changed since it was last painted
+    bool has_video;                // a video is placed in this subtree
     bool scroll;
     bool has_mouse;
 
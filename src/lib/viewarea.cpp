@@ -16,8 +16,11 @@
 #include <QMap>
 #include <QPalette>
 #include <QDesktopWidget>
+#include <QScreen>
+#include <QWindow>
 #include <QX11Info>
 #include <QPainter>
+#include <QRegion>
 #include <QMainWindow>
 #include <QStatusBar>
 #include <QWidgetAction>
@@ -25,6 +28,8 @@
 #include <QTextDocument>
 #include <QAbstractTextDocumentLayout>
 #include <QImage>
+#include <QCache>
+#include <QSet>
 #include <QAbstractNativeEventFilter>
 
 #include <KActionCollection>
@@ -38,6 +43,11 @@
 #ifdef KMPLAYER_WITH_CAIRO
 # include <cairo-xcb.h>
 #endif
+#ifdef KMPLAYER_WITH_XCB_SHM
+# include <sys/ipc.h>
+# include <sys/shm.h>
+# include <xcb/shm.h>
+#endif
 #include "mediaobject.h"
 #include "kmplayer_smil.h"
 #include "kmplayer_rp.h"
@@ -48,6 +58,7 @@
 using namespace KMPlayer;
 
 static qreal pixel_device_ratio;
+static unsigned int paint_frame;
 
 //-------------------------------------------------------------------------
 
@@ -60,56 +71,278 @@ static void clearSurface (cairo_t *cr, const IRect &rect) {
     cairo_restore (cr);
 }
 
-void ImageData::copyImage (Surface *s, const SSize &sz, cairo_surface_t *similar, CalculatedSizer *zoom) {
-    cairo_surface_t *src_sf;
-    bool clear = false;
-    int w = sz.width;
-    int h = sz.height;
+namespace KMPlayer {
 
-    if (surface) {
-        src_sf = surface;
-    } else {
-        if (image->depth () < 24) {
-            QImage qi = image->convertToFormat (QImage::Format_RGB32);
-            *image = qi;
-        }
-        src_sf = cairo_image_surface_create_for_data (
-                image->bits (),
-                has_alpha ? CAIRO_FORMAT_ARGB32:CAIRO_FORMAT_RGB24,
-                width, height, image->bytesPerLine ());
-        if (flags & ImagePixmap && !(flags & ImageAnimated)) {
-            surface = cairo_surface_create_similar (similar,
-                    has_alpha ? CAIRO_CONTENT_COLOR_ALPHA : CAIRO_CONTENT_COLOR,
-                    width, height);
-            cairo_pattern_t *pat = cairo_pattern_create_for_surface (src_sf);
-            cairo_pattern_set_extend (pat, CAIRO_EXTEND_NONE);
-            cairo_t *cr = cairo_create (surface);
+struct ScaledImage {
+    ScaledImage (cairo_surface_t *s, ImageDataPtrW img)
+        : surface (s), image (img) {}
+    ~ScaledImage () { cairo_surface_destroy (surface); }
+    cairo_surface_t *surface;
+    ImageDataPtrW image;
+};
+
+/**
+ * Images, their mip levels and RealPix source rectangles scaled to device
+ * size, owned by the ViewArea next to the SurfacePool. Cost is in KiB.
+ */
+class ScaledImageCache : public QCache <QString, ScaledImage>
+{
+public:
+    ScaledImageCache ()
+        : QCache <QString, ScaledImage> (32 * 1024), hits (0), misses (0) {}
+    cairo_surface_t *scaled (const QString &key, ImageData *img);
+    void insert (const QString &key, ImageDataPtrW img,
+            cairo_surface_t *sf, int width, int height);
+
+    int hits;
+    int misses;
+};
+
+}
+
+/* Returns a new reference to the copy stored for key, if made from img */
+cairo_surface_t *ScaledImageCache::scaled (const QString &key, ImageData *img) {
+    ScaledImage *cached = object (key);
+    if (cached && cached->image.ptr () == img) {
+        hits++;
+        return cairo_surface_reference (cached->surface);
+    }
+    misses++;
+    return nullptr;
+}
+
+/* Stores a copy of img, the cache takes its own reference on sf */
+void ScaledImageCache::insert (const QString &key, ImageDataPtrW img,
+        cairo_surface_t *sf, int width, int height) {
+    QCache <QString, ScaledImage>::insert (key,
+            new ScaledImage (cairo_surface_reference (sf), img),
+            qMax (1, width * height / 256));
+}
+
+namespace {
+
+/**
+ * Scratch surfaces for partial repaints and region layers. Sizes are
+ * rounded up to 64 pixels, so that a surface released in one frame can
+ * be reused for a slightly different damage rectangle in the next one.
+ * Owned by the ViewArea, the surfaces must go before the X connection.
+ */
+class SurfacePool
+{
+public:
+    enum { MaxBytes = 32 * 1024 * 1024, MaxLayerBytes = 32 * 1024 * 1024,
+           Granularity = 64 };
+
+    SurfacePool () : bytes (0), layer_bytes (0), hits (0), misses (0) {}
+    ~SurfacePool () {
+        for (int i = 0; i < entries.size (); ++i)
+            cairo_surface_destroy (entries[i].surface);
+    }
+    cairo_surface_t *acquire (cairo_surface_t *similar, cairo_content_t content,
+            int w, int h);
+    void release (cairo_surface_t *sf, int w, int h);
+    bool retainLayer (Surface *s, const ISize &size);
+
+    int bytes;
+    int layer_bytes;
+    int hits;
+    int misses;
+
+private:
+    struct Entry {
+        cairo_surface_t *surface;
+        cairo_surface_type_t type;
+        cairo_content_t content;
+        int width;
+        int height;
+    };
+    struct LayerUse {
+        SurfacePtrW surface;
+        unsigned int frame;
+    };
+    static int roundUp (int v) {
+        return (v + Granularity - 1) / Granularity * Granularity;
+    }
+    QList <Entry> entries; // least recently released first
+    QList <LayerUse> layers; // least recently composited first
+};
+
+cairo_surface_t *SurfacePool::acquire (cairo_surface_t *similar,
+        cairo_content_t content, int w, int h) {
+    const cairo_surface_type_t type = cairo_surface_get_type (similar);
+    w = roundUp (w);
+    h = roundUp (h);
+    for (int i = entries.size () - 1; i >= 0; --i) {
+        const Entry &e = entries[i];
+        if (e.type == type && e.content == content &&
+                e.width == w && e.height == h) {
+            cairo_surface_t *sf = e.surface;
+            bytes -= 4 * w * h;
+            entries.removeAt (i);
+            hits++;
+            return sf;
+        }
+    }
+    misses++;
+    return cairo_surface_create_similar (similar, content, w, h);
+}
+
+void SurfacePool::release (cairo_surface_t *sf, int w, int h) {
+    if (cairo_surface_get_reference_count (sf) > 1) {
+        cairo_surface_destroy (sf); // still in use elsewhere
+        return;
+    }
+    Entry e;
+    e.surface = sf;
+    e.type = cairo_surface_get_type (sf);
+    e.content = cairo_surface_get_content (sf);
+    e.width = roundUp (w);
+    e.height = roundUp (h);
+    entries.append (e);
+    bytes += 4 * e.width * e.height;
+    while (bytes > MaxBytes && !entries.isEmpty ()) {
+        const Entry &old = entries.first ();
+        bytes -= 4 * old.width * old.height;
+        cairo_surface_destroy (old.surface);
+        entries.removeFirst ();
+    }
+}
+
+/**
+ * Accounts a retained layer of size for s, composited in this frame.
+ * Layers not used in this frame are given back until all fit in
+ * MaxLayerBytes, returns false if s's layer still doesn't fit.
+ */
+bool SurfacePool::retainLayer (Surface *s, const ISize &size) {
+    layer_bytes = 4 * size.width * size.height;
+    for (int i = layers.size () - 1; i >= 0; --i) {
+        Surface *l = layers[i].surface.ptr ();
+        if (!l || !l->layer || l == s)
+            layers.removeAt (i);
+        else
+            layer_bytes += 4 * l->layer_size.width * l->layer_size.height;
+    }
+    while (layer_bytes > MaxLayerBytes && !layers.isEmpty () &&
+            layers.first ().frame != paint_frame) {
+        Surface *l = layers.first ().surface.ptr ();
+        layer_bytes -= 4 * l->layer_size.width * l->layer_size.height;
+        release (l->layer, l->layer_size.width, l->layer_size.height);
+        l->layer = nullptr;
+        layers.removeFirst ();
+    }
+    if (layer_bytes > MaxLayerBytes) {
+        layer_bytes -= 4 * size.width * size.height;
+        return false;
+    }
+    LayerUse use;
+    use.surface = s;
+    use.frame = paint_frame;
+    layers.append (use);
+    return true;
+}
+
+}
+
+/**
+ * Source for scaling an image down to w x h, the smallest half sized level
+ * that is not smaller than the target. Levels are kept in the view's cache,
+ * sw and sh are updated to the size of the returned surface.
+ */
+static cairo_surface_t *mipLevel (ScaledImageCache *cache, const QString &url,
+        ImageDataPtrW img, cairo_surface_t *src, int *sw, int *sh,
+        int w, int h, cairo_surface_t *similar) {
+    cairo_surface_t *level = cairo_surface_reference (src);
+    while (*sw / 2 >= w && *sh / 2 >= h && *sw > 1 && *sh > 1) {
+        const int hw = *sw / 2;
+        const int hh = *sh / 2;
+        const QString key = url + QString::asprintf ("\nmip%dx%d:%d", hw, hh,
+                (int) cairo_surface_get_type (similar));
+        cairo_surface_t *half = cache->scaled (key, img.ptr ());
+        if (!half) {
+            half = cairo_surface_create_similar (similar,
+                    cairo_surface_get_content (level), hw, hh);
+            cairo_t *cr = cairo_create (half);
+            cairo_scale (cr, 1.0 * hw / *sw, 1.0 * hh / *sh);
+            cairo_set_source_surface (cr, level, 0, 0);
+            cairo_pattern_set_filter (cairo_get_source (cr), CAIRO_FILTER_GOOD);
             cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
-            cairo_set_source (cr, pat);
             cairo_paint (cr);
             cairo_destroy (cr);
-            cairo_pattern_destroy (pat);
-            cairo_surface_destroy (src_sf);
-            src_sf = surface;
-            delete image;
-            image = nullptr;
+            cache->insert (key, img, half, hw, hh);
+        }
+        cairo_surface_destroy (level);
+        level = half;
+        *sw = hw;
+        *sh = hh;
+    }
+    return level;
+}
+
+void ImageData::copyImage (Surface *s, const SSize &sz, cairo_surface_t *similar,
+        ScaledImageCache *cache, CalculatedSizer *zoom) {
+    bool clear = false;
+    int w = sz.width;
+    int h = sz.height;
+    Single zx, zy, zw, zh;
+    if (zoom)
+        zoom->calcSizes (nullptr, nullptr, width, height, zx, zy, zw, zh);
+
+    // scaled copies of shared images are shared by all surfaces of the view
+    ImageCache *images = ImageCache::instance ();
+    ImageDataPtrW shared;
+    if (cache && images && !url.isEmpty () && !(flags & ImageAnimated))
+        shared = images->shared (url);
+    if (shared.ptr () != this)
+        cache = nullptr;
+    QString key;
+    if (cache) {
+        key = url + QString::asprintf ("\n%dx%d:%d", w, h,
+                (int) cairo_surface_get_type (similar));
+        if (zoom)
+            key += QString::asprintf ("\n%.2f,%.2f,%.2f,%.2f",
+                    (double) zx, (double) zy, (double) zw, (double) zh);
+        cairo_surface_t *sf = cache->scaled (key, this);
+        if (sf) {
+            if (s->surface)
+                cairo_surface_destroy (s->surface);
+            s->surface = sf;
+            return;
         }
     }
 
-    cairo_pattern_t *img_pat = cairo_pattern_create_for_surface (src_sf);
+    if (image->depth () < 24) {
+        QImage qi = image->convertToFormat (QImage::Format_RGB32);
+        *image = qi;
+    }
+    // only read from, don't detach an image shared with a cache
+    cairo_surface_t *src_sf = cairo_image_surface_create_for_data (
+            (unsigned char *) image->constBits (),
+            has_alpha ? CAIRO_FORMAT_ARGB32:CAIRO_FORMAT_RGB24,
+            width, height, image->bytesPerLine ());
+
+    int sw = width;
+    int sh = height;
+    cairo_surface_t *level = nullptr;
+    if (cache && !zoom && w > 0 && h > 0)
+        level = mipLevel (cache, url, shared, src_sf, &sw, &sh, w, h, similar);
+    cairo_pattern_t *img_pat = cairo_pattern_create_for_surface (
+            level ? level : src_sf);
     cairo_pattern_set_extend (img_pat, CAIRO_EXTEND_NONE);
     if (zoom) {
         cairo_matrix_t mat;
-        Single zx, zy, zw, zh;
-        zoom->calcSizes (nullptr, nullptr, width, height, zx, zy, zw, zh);
         cairo_matrix_init_translate (&mat, zx, zy);
         cairo_matrix_scale (&mat, 1.0 * zw/w, 1.0 * zh/h);
         cairo_pattern_set_matrix (img_pat, &mat);
-    } else if (w != width && h != height) {
+    } else if (w != sw || h != sh) {
         cairo_matrix_t mat;
-        cairo_matrix_init_scale (&mat, 1.0 * width/w, 1.0 * height/h);
+        cairo_matrix_init_scale (&mat, 1.0 * sw/w, 1.0 * sh/h);
         cairo_pattern_set_matrix (img_pat, &mat);
     }
+    if (cache && s->surface) {
+        // may be shared with the cache, never paint into it
+        cairo_surface_destroy (s->surface);
+        s->surface = nullptr;
+    }
     if (!s->surface)
         s->surface = cairo_surface_create_similar (similar,
                 has_alpha ?
@@ -125,8 +358,11 @@ void ImageData::copyImage (Surface *s, const SSize &sz, cairo_surface_t *similar
     cairo_destroy (cr);
 
     cairo_pattern_destroy (img_pat);
-    if (!surface)
-        cairo_surface_destroy (src_sf);
+    if (level)
+        cairo_surface_destroy (level);
+    if (cache)
+        cache->insert (key, shared, s->surface, w, h);
+    cairo_surface_destroy (src_sf);
 }
 #endif
 
@@ -168,21 +404,29 @@ struct PaintContext
 class CairoPaintVisitor : public Visitor, public PaintContext
 {
     cairo_surface_t * cairo_surface;
+    SurfacePool *pool;
+    ScaledImageCache *scaled_images;
     // stack vars need for transitions
     TransitionModule *cur_transition;
     cairo_pattern_t * cur_pat;
     cairo_matrix_t cur_mat;
+    cairo_surface_t * cur_mask;   // wipe shape, set by transition visit
+    cairo_matrix_t cur_mask_mat;
     float opacity;
+    Surface *layer_surface;       // region rendered into its retained layer
     bool toplevel;
 
     void traverseRegion (Node *reg, Surface *s);
+    bool compositeLayer (SMIL::RegionBase *reg, Surface *s, const IRect &scr);
+    void maskTransition (float alpha);
     void updateExternal (SMIL::MediaType *av, SurfacePtr s);
     void paint (TransitionModule *trans, MediaOpacity mopacity, Surface *s,
                 const IPoint &p, const IRect &);
     void video (Mrl *mt, Surface *s);
 public:
     cairo_t * cr;
-    CairoPaintVisitor (cairo_surface_t * cs, Matrix m,
+    CairoPaintVisitor (cairo_surface_t * cs, SurfacePool *pool,
+            ScaledImageCache *scaled_images, Matrix m,
             const IRect & rect, QColor c=QColor(), bool toplevel=false);
     ~CairoPaintVisitor () override;
     using Visitor::visit;
@@ -204,9 +448,11 @@ public:
     void visit (RP::ViewChange *) override;
 };
 
-CairoPaintVisitor::CairoPaintVisitor (cairo_surface_t * cs, Matrix m,
-        const IRect & rect, QColor c, bool top)
- : PaintContext (m, rect), cairo_surface (cs), toplevel (top)
+CairoPaintVisitor::CairoPaintVisitor (cairo_surface_t * cs, SurfacePool *p,
+        ScaledImageCache *sc, Matrix m, const IRect & rect, QColor c, bool top)
+ : PaintContext (m, rect), cairo_surface (cs), pool (p), scaled_images (sc),
+   cur_mask (nullptr),
+   layer_surface (nullptr), toplevel (top)
 {
     cr = cairo_create (cs);
     if (toplevel) {
@@ -258,11 +504,12 @@ void CairoPaintVisitor::traverseRegion (Node *node, Surface *s) {
             break;
     }*/
     // finally visit region children
-    for (SurfacePtr c = s->firstChild (); c; c = c->nextSibling ()) {
-        if (c->node && c->node->id == SMIL::id_node_region)
+    const Surface::ZOrderMap children = s->z_children;
+    const Surface::ZOrderMap::const_iterator e = children.constEnd ();
+    for (Surface::ZOrderMap::const_iterator i = children.constBegin (); i != e; ++i) {
+        SurfacePtr c = i.value ();
+        if (c && c->node && c->node->id == SMIL::id_node_region)
             c->node->accept (this);
-        else
-            break;
     }
     s->dirty = false;
 }
@@ -288,6 +535,12 @@ void CairoPaintVisitor::visit (SMIL::RegionBase *reg) {
         IRect scr = matrix.toScreen (rect);
         if (clip.intersect (scr).isEmpty ())
             return;
+        if (SMIL::id_node_region == reg->id && s != layer_surface &&
+                compositeLayer (reg, s, scr))
+            return;
+        s->layer_stale = false;
+        s->has_video = false;
+        s->painted_frame = paint_frame;
         PaintContext ctx_save = *(PaintContext *) this;
         matrix = Matrix (rect.x(), rect.y(), s->xscale, s->yscale);
         matrix.transform (ctx_save.matrix);
@@ -335,7 +588,7 @@ void CairoPaintVisitor::visit (SMIL::RegionBase *reg) {
                 Single h = bg_img->height;
                 matrix.getWH (w, h);
                 if (!s->surface)
-                    bg_img->copyImage (s, SSize (w, h), cairo_surface);
+                    bg_img->copyImage (s, SSize (w, h), cairo_surface, scaled_images);
                 if (bg_img->has_alpha)
                     cairo_set_operator (cr, CAIRO_OPERATOR_OVER);
                 cairo_pattern_t *pat = cairo_pattern_create_for_surface (s->surface);
@@ -377,8 +630,10 @@ void CairoPaintVisitor::visit (SMIL::RegionBase *reg) {
         if (cs && (s->scroll || cs->scroll) && cs == s->lastChild ()) {
             SRect r = cs->bounds;
             if (r.width () > rect.width () || r.height () > rect.height ()) {
-                if (s->virtual_size.isEmpty ())
+                if (s->virtual_size.isEmpty ()) {
                     s->x_scroll = s->y_scroll = 0;
+                    s->boundsChanged ();
+                }
                 s->virtual_size = r.size;
                 matrix.getWH (s->virtual_size.width, s->virtual_size.height);
                 s->virtual_size.width += REGION_SCROLLBAR_WIDTH;
@@ -455,6 +710,68 @@ void CairoPaintVisitor::visit (SMIL::RegionBase *reg) {
     }
 }
 
+/**
+ * Paints a region whose content did not change since the previous frame from
+ * its retained layer, so that moving it or damage from overlapping siblings
+ * only composites. Returns false when the region must be painted itself.
+ */
+bool CairoPaintVisitor::compositeLayer (SMIL::RegionBase *reg, Surface *s,
+        const IRect &scr) {
+    if (s->layer && (s->layer_stale || s->layer_size != scr.size)) {
+        pool->release (s->layer,
+                s->layer_size.width, s->layer_size.height);
+        s->layer = nullptr;
+    }
+    if (s->layer_stale || s->has_video || s->painted_frame == paint_frame)
+        return false;
+    if (!pool->retainLayer (s, scr.size)) {
+        if (s->layer) {
+            pool->release (s->layer,
+                    s->layer_size.width, s->layer_size.height);
+            s->layer = nullptr;
+        }
+        return false;
+    }
+    // paint and composite with the operator the region would get directly
+    cairo_operator_t op = cairo_get_operator (cr);
+    if (!s->layer) {
+        s->layer = pool->acquire (cairo_surface,
+                CAIRO_CONTENT_COLOR_ALPHA, scr.width (), scr.height ());
+        s->layer_size = scr.size;
+        Matrix m = matrix;
+        m.translate (-scr.x (), -scr.y ());
+        CairoPaintVisitor visitor (s->layer, pool, scaled_images,
+                m, IRect (0, 0, scr.size));
+        visitor.fit = fit;
+        visitor.bg_repeat = bg_repeat;
+        visitor.bg_image = bg_image;
+        visitor.layer_surface = s;
+        cairo_set_operator (visitor.cr, op);
+        reg->accept (&visitor);
+    }
+    // but keep what is below where the region has no opaque background
+    if (CAIRO_OPERATOR_SOURCE == op &&
+            ((s->background_color & 0xff000000) != 0xff000000 ||
+             (SMIL::RegionBase::ShowAlways != reg->show_background &&
+              !reg->m_AttachedMediaTypes.first ())))
+        op = CAIRO_OPERATOR_OVER;
+    IRect r = clip.intersect (scr);
+    cairo_save (cr);
+    cairo_set_operator (cr, op);
+    cairo_set_source_surface (cr, s->layer, scr.x (), scr.y ());
+    cairo_rectangle (cr, r.x (), r.y (), r.width (), r.height ());
+    cairo_fill (cr);
+    cairo_restore (cr);
+    if (s->has_video) {
+        // the video widget must follow the region, paint it from now on
+        pool->release (s->layer,
+                s->layer_size.width, s->layer_size.height);
+        s->layer = nullptr;
+    }
+    s->dirty = false;
+    return true;
+}
+
 #define CAIRO_SET_PATTERN_COND(cr,pat,mat)                      \
     if (pat) {                                                  \
         cairo_pattern_set_extend (cur_pat, CAIRO_EXTEND_NONE);  \
@@ -463,83 +780,44 @@ void CairoPaintVisitor::visit (SMIL::RegionBase *reg) {
         cairo_set_source (cr, pat);                             \
     }
 
-void CairoPaintVisitor::visit (SMIL::Transition *trans) {
-    float perc = trans->start_progress + (trans->end_progress - trans->start_progress)*cur_transition->trans_gain;
-    if (cur_transition->trans_out_active)
-        perc = 1.0 - perc;
-    if (SMIL::Transition::Fade == trans->type) {
-        CAIRO_SET_PATTERN_COND(cr, cur_pat, cur_mat)
-        cairo_rectangle (cr, clip.x(), clip.y(), clip.width(), clip.height());
-        opacity = perc;
-    } else if (SMIL::Transition::BarWipe == trans->type) {
-        IRect rect;
-        if (SMIL::Transition::SubTopToBottom == trans->sub_type) {
-            if (SMIL::Transition::dir_reverse == trans->direction) {
-                int dy = (int) ((1.0 - perc) * clip.height ());
-                rect = IRect (clip.x (), clip.y () + dy,
-                        clip.width (), clip.height () - dy);
-            } else {
-                rect = IRect (clip.x (), clip.y (),
-                        clip.width (), (int) (perc * clip.height ()));
-            }
-        } else {
-            if (SMIL::Transition::dir_reverse == trans->direction) {
-                int dx = (int) ((1.0 - perc) * clip.width ());
-                rect = IRect (clip.x () + dx, clip.y (),
-                        clip.width () - dx, clip.height ());
-            } else {
-                rect = IRect (clip.x (), clip.y (),
-                        (int) (perc * clip.width ()), clip.height ());
-            }
-        }
-        cairo_rectangle (cr, rect.x(), rect.y(), rect.width(), rect.height());
-        CAIRO_SET_PATTERN_COND(cr, cur_pat, cur_mat)
-    } else if (SMIL::Transition::PushWipe == trans->type) {
-        int dx = 0, dy = 0;
-        if (SMIL::Transition::SubFromTop == trans->sub_type)
-            dy = -(int) ((1.0 - perc) * clip.height ());
-        else if (SMIL::Transition::SubFromRight == trans->sub_type)
-            dx = (int) ((1.0 - perc) * clip.width ());
-        else if (SMIL::Transition::SubFromBottom == trans->sub_type)
-            dy = (int) ((1.0 - perc) * clip.height ());
-        else //if (SMIL::Transition::SubFromLeft == trans->sub_type)
-            dx = -(int) ((1.0 - perc) * clip.width ());
-        cairo_matrix_translate (&cur_mat, -dx, -dy);
-        IRect rect = clip.intersect (IRect (clip.x () + dx, clip.y () + dy,
-                    clip.width (), clip.height ()));
-        cairo_rectangle (cr, rect.x(), rect.y(), rect.width(), rect.height());
-        CAIRO_SET_PATTERN_COND(cr, cur_pat, cur_mat)
-    } else if (SMIL::Transition::IrisWipe == trans->type) {
-        CAIRO_SET_PATTERN_COND(cr, cur_pat, cur_mat)
-        if (SMIL::Transition::SubDiamond == trans->sub_type) {
-            cairo_rectangle (cr, clip.x(), clip.y(),clip.width(),clip.height());
-            cairo_clip (cr);
-            int dx = (int) (perc * clip.width ());
-            int dy = (int) (perc * clip.height ());
-            int mx = clip.x () + clip.width ()/2;
-            int my = clip.y () + clip.height ()/2;
-            cairo_new_path (cr);
-            cairo_move_to (cr, mx, my - dy);
-            cairo_line_to (cr, mx + dx, my);
-            cairo_line_to (cr, mx, my + dy);
-            cairo_line_to (cr, mx - dx, my);
-            cairo_close_path (cr);
-        } else { // SubRectangle
-            int dx = (int) (0.5 * (1 - perc) * clip.width ());
-            int dy = (int) (0.5 * (1 - perc) * clip.height ());
-            cairo_rectangle (cr, clip.x () + dx, clip.y () + dy,
-                    clip.width () - 2 * dx, clip.height () -2 * dy);
-        }
+namespace {
+
+struct TransitionMask {
+    TransitionMask (cairo_surface_t *s) : surface (s) {}
+    ~TransitionMask () { cairo_surface_destroy (surface); }
+    cairo_surface_t *surface;
+};
+
+}
+
+static const int transition_mask_steps = 64;
+static const int transition_mask_max_size = 512;
+
+static QCache <quint64, TransitionMask> &transitionMaskCache () {
+    static QCache <quint64, TransitionMask> cache (16 * 1024); // cost in KiB
+    return cache;
+}
+
+/**
+ * Path of the diamond iris, clock, bow-tie and ellipse wipes in a w x h area
+ */
+static void transitionPath (cairo_t *cr, SMIL::Transition *trans,
+        int w, int h, float perc) {
+    int mx = w/2;
+    int my = h/2;
+    float hw = 1.0 * w/2;
+    float hh = 1.0 * h/2;
+    float radius = sqrtf (hw * hw + hh * hh);
+    if (SMIL::Transition::IrisWipe == trans->type) { // SubDiamond
+        int dx = (int) (perc * w);
+        int dy = (int) (perc * h);
+        cairo_move_to (cr, mx, my - dy);
+        cairo_line_to (cr, mx + dx, my);
+        cairo_line_to (cr, mx, my + dy);
+        cairo_line_to (cr, mx - dx, my);
+        cairo_close_path (cr);
     } else if (SMIL::Transition::ClockWipe == trans->type) {
-        cairo_rectangle (cr, clip.x(), clip.y(), clip.width(), clip.height());
-        cairo_clip (cr);
-        int mx = clip.x () + clip.width ()/2;
-        int my = clip.y () + clip.height ()/2;
-        cairo_new_path (cr);
         cairo_move_to (cr, mx, my);
-        float hw = 1.0 * clip.width ()/2;
-        float hh = 1.0 * clip.height ()/2;
-        float radius = sqrtf (hw * hw + hh * hh);
         float phi;
         switch (trans->sub_type) {
             case SMIL::Transition::SubClockwiseThree:
@@ -560,17 +838,8 @@ void CairoPaintVisitor::visit (SMIL::Transition *trans) {
         else
             cairo_arc (cr, mx, my, radius, phi, phi + 2 * M_PI * perc);
         cairo_close_path (cr);
-        CAIRO_SET_PATTERN_COND(cr, cur_pat, cur_mat)
     } else if (SMIL::Transition::BowTieWipe == trans->type) {
-        cairo_rectangle (cr, clip.x(), clip.y(), clip.width(), clip.height());
-        cairo_clip (cr);
-        int mx = clip.x () + clip.width ()/2;
-        int my = clip.y () + clip.height ()/2;
-        cairo_new_path (cr);
         cairo_move_to (cr, mx, my);
-        float hw = 1.0 * clip.width ()/2;
-        float hh = 1.0 * clip.height ()/2;
-        float radius = sqrtf (hw * hw + hh * hh);
         float phi;
         switch (trans->sub_type) {
             case SMIL::Transition::SubHorizontal:
@@ -590,18 +859,9 @@ void CairoPaintVisitor::visit (SMIL::Transition *trans) {
         else
             cairo_arc (cr, mx, my, radius, -phi - dphi, -phi + dphi);
         cairo_close_path (cr);
-        CAIRO_SET_PATTERN_COND(cr, cur_pat, cur_mat)
-    } else if (SMIL::Transition::EllipseWipe == trans->type) {
-        cairo_rectangle (cr, clip.x(), clip.y(), clip.width(), clip.height());
-        cairo_clip (cr);
-        int mx = clip.x () + clip.width ()/2;
-        int my = clip.y () + clip.height ()/2;
-        float hw = (double) clip.width ()/2;
-        float hh = (double) clip.height ()/2;
-        float radius = sqrtf (hw * hw + hh * hh);
+    } else { // EllipseWipe
         cairo_save (cr);
-        cairo_new_path (cr);
-        cairo_translate (cr, (int) mx, (int) my);
+        cairo_translate (cr, mx, my);
         cairo_move_to (cr, - Single (radius), 0);
         if (SMIL::Transition::SubHorizontal == trans->sub_type)
             cairo_scale (cr, 1.0, 0.6);
@@ -610,7 +870,112 @@ void CairoPaintVisitor::visit (SMIL::Transition *trans) {
         cairo_arc (cr, 0, 0, perc * radius, 0, 2 * M_PI);
         cairo_close_path (cr);
         cairo_restore (cr);
+    }
+}
+
+/**
+ * Returns a referenced alpha mask for the wipe of trans over rect at perc.
+ * Masks are rendered at most transition_mask_max_size wide or high and
+ * cached per quantised progress, so repeating the same transition or
+ * repainting a frame only composites.
+ * The mask matrix maps user space to mask space.
+ */
+static cairo_surface_t *transitionMask (SMIL::Transition *trans,
+        const IRect &rect, float perc, cairo_matrix_t *mat) {
+    int w = rect.width ();
+    int h = rect.height ();
+    float scale = 1.0;
+    if (w > transition_mask_max_size || h > transition_mask_max_size)
+        scale = 1.0 * transition_mask_max_size / qMax (w, h);
+    int mw = qMax (1, (int) ceil (scale * w));
+    int mh = qMax (1, (int) ceil (scale * h));
+    int step = (int) (perc * transition_mask_steps + 0.5);
+    cairo_matrix_init_scale (mat, scale, scale);
+    cairo_matrix_translate (mat, -rect.x (), -rect.y ());
+
+    quint64 key = ((quint64) (trans->type & 0xff) << 56) |
+        ((quint64) (trans->sub_type & 0xff) << 48) |
+        ((quint64) (SMIL::Transition::dir_reverse == trans->direction) << 47) |
+        ((quint64) (w & 0xffff) << 31) |
+        ((quint64) (h & 0xffff) << 15) |
+        (quint64) (step & 0x7fff);
+    TransitionMask *mask = transitionMaskCache ().object (key);
+    if (mask)
+        return cairo_surface_reference (mask->surface);
+
+    cairo_surface_t *sf = cairo_image_surface_create (CAIRO_FORMAT_A8, mw, mh);
+    cairo_t *cr_mask = cairo_create (sf);
+    cairo_scale (cr_mask, scale, scale);
+    transitionPath (cr_mask, trans, w, h, 1.0 * step / transition_mask_steps);
+    cairo_set_source_rgba (cr_mask, 0, 0, 0, 1.0);
+    cairo_fill (cr_mask);
+    cairo_destroy (cr_mask);
+    transitionMaskCache ().insert (key,
+            new TransitionMask (cairo_surface_reference (sf)),
+            qMax (1, cairo_image_surface_get_stride (sf) * mh / 1024));
+    return sf;
+}
+
+void CairoPaintVisitor::visit (SMIL::Transition *trans) {
+    float perc = trans->start_progress + (trans->end_progress - trans->start_progress)*cur_transition->trans_gain;
+    if (cur_transition->trans_out_active)
+        perc = 1.0 - perc;
+    if (SMIL::Transition::Fade == trans->type) {
+        CAIRO_SET_PATTERN_COND(cr, cur_pat, cur_mat)
+        cairo_rectangle (cr, clip.x(), clip.y(), clip.width(), clip.height());
+        opacity = perc;
+    } else if (SMIL::Transition::BarWipe == trans->type) {
+        IRect rect;
+        if (SMIL::Transition::SubTopToBottom == trans->sub_type) {
+            if (SMIL::Transition::dir_reverse == trans->direction) {
+                int dy = (int) ((1.0 - perc) * clip.height ());
+                rect = IRect (clip.x (), clip.y () + dy,
+                        clip.width (), clip.height () - dy);
+            } else {
+                rect = IRect (clip.x (), clip.y (),
+                        clip.width (), (int) (perc * clip.height ()));
+            }
+        } else {
+            if (SMIL::Transition::dir_reverse == trans->direction) {
+                int dx = (int) ((1.0 - perc) * clip.width ());
+                rect = IRect (clip.x () + dx, clip.y (),
+                        clip.width () - dx, clip.height ());
+            } else {
+                rect = IRect (clip.x (), clip.y (),
+                        (int) (perc * clip.width ()), clip.height ());
+            }
+        }
+        cairo_rectangle (cr, rect.x(), rect.y(), rect.width(), rect.height());
         CAIRO_SET_PATTERN_COND(cr, cur_pat, cur_mat)
+    } else if (SMIL::Transition::PushWipe == trans->type) {
+        int dx = 0, dy = 0;
+        if (SMIL::Transition::SubFromTop == trans->sub_type)
+            dy = -(int) ((1.0 - perc) * clip.height ());
+        else if (SMIL::Transition::SubFromRight == trans->sub_type)
+            dx = (int) ((1.0 - perc) * clip.width ());
+        else if (SMIL::Transition::SubFromBottom == trans->sub_type)
+            dy = (int) ((1.0 - perc) * clip.height ());
+        else //if (SMIL::Transition::SubFromLeft == trans->sub_type)
+            dx = -(int) ((1.0 - perc) * clip.width ());
+        cairo_matrix_translate (&cur_mat, -dx, -dy);
+        IRect rect = clip.intersect (IRect (clip.x () + dx, clip.y () + dy,
+                    clip.width (), clip.height ()));
+        cairo_rectangle (cr, rect.x(), rect.y(), rect.width(), rect.height());
+        CAIRO_SET_PATTERN_COND(cr, cur_pat, cur_mat)
+    } else if (SMIL::Transition::IrisWipe == trans->type &&
+            SMIL::Transition::SubDiamond != trans->sub_type) {
+        CAIRO_SET_PATTERN_COND(cr, cur_pat, cur_mat)
+        int dx = (int) (0.5 * (1 - perc) * clip.width ());
+        int dy = (int) (0.5 * (1 - perc) * clip.height ());
+        cairo_rectangle (cr, clip.x () + dx, clip.y () + dy,
+                clip.width () - 2 * dx, clip.height () -2 * dy);
+    } else if (SMIL::Transition::IrisWipe == trans->type ||
+            SMIL::Transition::ClockWipe == trans->type ||
+            SMIL::Transition::BowTieWipe == trans->type ||
+            SMIL::Transition::EllipseWipe == trans->type) {
+        CAIRO_SET_PATTERN_COND(cr, cur_pat, cur_mat)
+        cairo_rectangle (cr, clip.x(), clip.y(), clip.width(), clip.height());
+        cur_mask = transitionMask (trans, clip, perc, &cur_mask_mat);
     }
 }
 
@@ -621,6 +986,8 @@ void CairoPaintVisitor::video (Mrl *m, Surface *s) {
              MediaManager::AudioVideo == m->media_info->type)) {
         AudioVideoMedia *avm = static_cast<AudioVideoMedia *> (m->media_info->media);
         if (avm->viewer ()) {
+            for (Surface *ps = s; ps; ps = ps->parentNode ())
+                ps->has_video = true;
             if (s &&
                     avm->process &&
                     avm->process->state () > IProcess::Ready &&
@@ -667,7 +1034,8 @@ void CairoPaintVisitor::visit (SMIL::RefMediaType *ref) {
             return;
         }
         if (!s->surface || s->dirty)
-            id->copyImage (s, SSize (scr.width (), scr.height ()), cairo_surface, ref->pan_zoom);
+            id->copyImage (s, SSize (scr.width (), scr.height ()), cairo_surface,
+                    scaled_images, ref->pan_zoom);
         paint (&ref->transition, ref->media_opacity, s, scr.point, clip_rect);
         s->dirty = false;
     } else {
@@ -703,7 +1071,9 @@ void CairoPaintVisitor::paint (TransitionModule *trans,
         op = cairo_get_operator (cr);
         cairo_set_operator (cr, CAIRO_OPERATOR_OVER);
     }
-    if (opacity < 0.99) {
+    if (cur_mask) {
+        maskTransition (opacity);
+    } else if (opacity < 0.99) {
         cairo_clip (cr);
         cairo_paint_with_alpha (cr, opacity);
     } else {
@@ -715,6 +1085,27 @@ void CairoPaintVisitor::paint (TransitionModule *trans,
     cairo_restore (cr);
 }
 
+/**
+ * Composites current source within current path through the transition mask
+ */
+void CairoPaintVisitor::maskTransition (float alpha) {
+    cairo_clip (cr);
+    cairo_pattern_t *mask = cairo_pattern_create_for_surface (cur_mask);
+    cairo_pattern_set_matrix (mask, &cur_mask_mat);
+    cairo_pattern_set_filter (mask, CAIRO_FILTER_BILINEAR);
+    if (alpha < 0.99) {
+        cairo_push_group (cr);
+        cairo_mask (cr, mask);
+        cairo_pop_group_to_source (cr);
+        cairo_paint_with_alpha (cr, alpha);
+    } else {
+        cairo_mask (cr, mask);
+    }
+    cairo_pattern_destroy (mask);
+    cairo_surface_destroy (cur_mask);
+    cur_mask = nullptr;
+}
+
 static Mrl *findActiveMrl (Node *n, bool *rp_or_smil) {
     Mrl *mrl = n->mrl ();
     if (mrl) {
@@ -761,7 +1152,7 @@ void CairoPaintVisitor::updateExternal (SMIL::MediaType *av, SurfacePtr s) {
                     CAIRO_CONTENT_COLOR_ALPHA, scr.width (), scr.height ());
             r = IRect (0, 0, scr.size);
         }
-        CairoPaintVisitor visitor (s->surface, m, r);
+        CairoPaintVisitor visitor (s->surface, pool, scaled_images, m, r);
         ext_mrl->accept (&visitor);
         s->dirty = false;
     }
@@ -800,6 +1191,75 @@ static void calculateTextDimensions (const QFont& font,
     *pxw = qMin( (int)(*pxw + pixel_device_ratio), (int)w);
 }
 
+static QCache <QString, QImage> &textLayoutCache () {
+    static QCache <QString, QImage> cache (8 * 1024); // cost in KiB
+    return cache;
+}
+
+/**
+ * Lays out and paints text in an image of width w and height h, or when h
+ * is negative, of the text's dimensions within w and maxh.
+ * Images are cached, so recreating a surface for the same text, eg. when
+ * it is moved, scrolled or repeated, doesn't lay out the text again.
+ */
+static QImage renderText (const QFont &font, const QString &text,
+        bool markup, int w, int h, int maxh, unsigned char align,
+        const QColor &color, unsigned int background) {
+    const QString key = QString::asprintf ("%d:%d:%d:%d:%d:%x:%x:",
+            markup, w, h, maxh, align,
+            color.isValid () ? color.rgba () : 0, background) +
+        font.key () + QChar ('\n') + text;
+    QImage *cached = textLayoutCache ().object (key);
+    if (cached)
+        return *cached;
+
+    int pxw = w;
+    int pxh = h;
+    if (h < 0)
+        calculateTextDimensions (font, text, w, 2 * font.pixelSize (), maxh,
+                &pxw, &pxh, markup, align);
+    QTextDocument td;
+    td.setDocumentMargin (0);
+    td.setDefaultFont (font);
+    bool have_alpha = (background & 0xff000000) < 0xff000000;
+    QImage img (QSize (pxw, pxh), have_alpha ? QImage::Format_ARGB32 : QImage::Format_RGB32);
+    img.fill (background);
+    td.setPageSize (QSize (pxw, pxh + font.pixelSize ()));
+    td.documentLayout()->setPaintDevice (&img);
+    setAlignment (td, align);
+    if (markup)
+        td.setHtml (text);
+    else
+        td.setPlainText (text);
+    QPainter painter;
+    painter.begin (&img);
+    QAbstractTextDocumentLayout::PaintContext ctx;
+    ctx.clip = QRect (0, 0, pxw, pxh);
+    if (color.isValid ())
+        ctx.palette.setColor (QPalette::Text, color);
+    td.documentLayout()->draw (&painter, ctx);
+    painter.end();
+
+    textLayoutCache ().insert (key, new QImage (img),
+            qMax (1, (int) (img.sizeInBytes () / 1024)));
+    return img;
+}
+
+static void copyTextImage (cairo_t *cr, const QImage &img) {
+    cairo_surface_t *src_sf = cairo_image_surface_create_for_data (
+            (unsigned char *) img.constBits (),
+            img.hasAlphaChannel () ? CAIRO_FORMAT_ARGB32 : CAIRO_FORMAT_RGB24,
+            img.width(), img.height(), img.bytesPerLine ());
+    cairo_pattern_t *pat = cairo_pattern_create_for_surface (src_sf);
+    cairo_pattern_set_extend (pat, CAIRO_EXTEND_NONE);
+    cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
+    cairo_set_source (cr, pat);
+    cairo_rectangle (cr, 0, 0, img.width(), img.height());
+    cairo_fill (cr);
+    cairo_pattern_destroy (pat);
+    cairo_surface_destroy (src_sf);
+}
+
 static cairo_t *createContext (cairo_surface_t *similar, Surface *s, int w, int h) {
     unsigned int bg_alpha = s->background_color & 0xff000000;
     bool clear = s->surface;
@@ -834,60 +1294,36 @@ void CairoPaintVisitor::visit (SMIL::TextMediaType * txt) {
     if (!s->surface) {
         txt->size = SSize ();
         s->bounds = txt->calculateBounds ();
+        s->boundsChanged ();
     }
     IRect scr = matrix.toScreen (s->bounds);
     if (!s->surface || s->dirty) {
 
         int w = scr.width ();
-        int pxw, pxh;
         Single ft_size = w * txt->font_size / (double)s->bounds.width ();
         bool clear = s->surface;
 
         QFont font (txt->font_name);
         font.setPixelSize(ft_size);
-        if (clear) {
-            pxw = scr.width ();
-            pxh = scr.height ();
-        } else {
-            calculateTextDimensions (font, tm->text,
-                    w, 2 * ft_size, scr.height (), &pxw, &pxh, false);
-        }
-        QTextDocument td;
-        td.setDocumentMargin (0);
-        td.setDefaultFont (font);
-        bool have_alpha = (s->background_color & 0xff000000) < 0xff000000;
-        QImage img (QSize (pxw, pxh), have_alpha ? QImage::Format_ARGB32 : QImage::Format_RGB32);
-        img.fill (s->background_color);
-        td.setPageSize (QSize (pxw, pxh + (int)ft_size));
-        td.documentLayout()->setPaintDevice (&img);
-        setAlignment (td, 1 + (int)txt->halign);
-        td.setPlainText (tm->text);
-        QPainter painter;
-        painter.begin (&img);
-        QAbstractTextDocumentLayout::PaintContext ctx;
-        ctx.clip = QRect (0, 0, pxw, pxh);
-        ctx.palette.setColor (QPalette::Text, QColor (QRgb (txt->font_color)));
-        td.documentLayout()->draw (&painter, ctx);
-        painter.end();
+        QImage img = renderText (font, tm->text, false,
+                w, clear ? scr.height () : -1, scr.height (),
+                1 + (int)txt->halign, QColor (QRgb (txt->font_color)),
+                s->background_color);
+        int pxw = img.width ();
+        int pxh = img.height ();
 
         cairo_t *cr_txt = createContext (cairo_surface, s, pxw, pxh);
-        cairo_surface_t *src_sf = cairo_image_surface_create_for_data (
-                img.bits (),
-                have_alpha ? CAIRO_FORMAT_ARGB32:CAIRO_FORMAT_RGB24,
-                img.width(), img.height(), img.bytesPerLine ());
-        cairo_pattern_t *pat = cairo_pattern_create_for_surface (src_sf);
-        cairo_pattern_set_extend (pat, CAIRO_EXTEND_NONE);
-        cairo_set_operator (cr_txt, CAIRO_OPERATOR_SOURCE);
-        cairo_set_source (cr_txt, pat);
-        cairo_paint (cr_txt);
-        cairo_pattern_destroy (pat);
-        cairo_surface_destroy (src_sf);
+        copyTextImage (cr_txt, img);
         cairo_destroy (cr_txt);
 
         // update bounds rect
         SRect rect = matrix.toUser (IRect (scr.point, ISize (pxw, pxh)));
         txt->size = rect.size;
-        s->bounds = txt->calculateBounds ();
+        SRect bounds = txt->calculateBounds ();
+        if (bounds != s->bounds) {
+            s->bounds = bounds;
+            s->boundsChanged ();
+        }
 
         // update coord. for painting below
         scr = matrix.toScreen (s->bounds);
@@ -932,7 +1368,10 @@ void CairoPaintVisitor::visit (SMIL::Brush * brush) {
         } else {
             CAIRO_SET_SOURCE_RGB (cr, color);
         }
-        cairo_fill (cr);
+        if (cur_mask)
+            maskTransition (1.0);
+        else
+            cairo_fill (cr);
         if (opacity < 0.99)
             cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
         s->dirty = false;
@@ -941,14 +1380,11 @@ void CairoPaintVisitor::visit (SMIL::Brush * brush) {
 }
 
 struct SmilTextBlock {
-    SmilTextBlock (const QFont& f, const QString &t,
-            IRect r, unsigned char a)
-        : font (f), rich_text (t), rect (r), align (a), next (nullptr) {}
+    SmilTextBlock (const QImage &img, IRect r)
+        : image (img), rect (r), next (nullptr) {}
 
-    QFont font;
-    QString rich_text;
+    QImage image;
     IRect rect;
-    unsigned char align;
 
     SmilTextBlock *next;
 };
@@ -966,9 +1402,10 @@ struct SmilTextInfo
 class SmilTextVisitor : public Visitor
 {
 public:
-    SmilTextVisitor (int w, float s, const SmilTextProperties &p)
+    SmilTextVisitor (int w, float s, const SmilTextProperties &p,
+            unsigned int bg)
         : first (nullptr), last (nullptr), width (w), voffset (0),
-          scale (s), max_font_size (0), info (p) {
+          scale (s), background (bg), info (p) {
          info.span (scale);
     }
     using Visitor::visit;
@@ -985,7 +1422,7 @@ public:
     int width;
     int voffset;
     float scale;
-    float max_font_size;
+    unsigned int background;
     SmilTextInfo info;
     QString rich_text;
 };
@@ -1038,29 +1475,25 @@ void SmilTextVisitor::addRichText (const QString &txt) {
 
 void SmilTextVisitor::push () {
     if (!rich_text.isEmpty ()) {
-        int pxw, pxh;
         float fs = info.props.font_size.size ();
         if (fs < 0)
             fs = TextMedia::defaultFontSize ();
-        float maxfs = max_font_size;
-        if (maxfs < 1.0)
-            maxfs = fs;
         fs *= scale;
-        maxfs *= scale;
 
         QFont font ("Sans");
         font.setPixelSize((int)fs);
-        calculateTextDimensions (font, rich_text.toUtf8 ().constData (),
-                width, 2 * maxfs, 1024, &pxw, &pxh, true, info.props.text_align);
+        QImage img = renderText (font, rich_text, true, width, -1, 1024,
+                info.props.text_align, QColor (), background);
+        int pxw = img.width ();
+        int pxh = img.height ();
         int x = 0;
         if (SmilTextProperties::AlignCenter == info.props.text_align)
             x = (width - pxw) / 2;
         else if (SmilTextProperties::AlignRight == info.props.text_align)
             x = width - pxw;
-        SmilTextBlock *block = new SmilTextBlock (font, rich_text,
-                IRect (x, voffset, pxw, pxh), info.props.text_align);
+        SmilTextBlock *block = new SmilTextBlock (img,
+                IRect (x, voffset, pxw, pxh));
         voffset += pxh;
-        max_font_size = 0;
         rich_text.clear();
         if (!first) {
             first = last = block;
@@ -1097,8 +1530,6 @@ void SmilTextVisitor::visit (SMIL::TextFlow *flow) {
             push ();
 
         info.props.mask (flow->props);
-        if ((float)info.props.font_size.size () > max_font_size)
-            max_font_size = info.props.font_size.size ();
         info.span (scale);
 
         if (flow->firstChild ())
@@ -1134,7 +1565,7 @@ void CairoPaintVisitor::visit (SMIL::SmilText *txt) {
 
         int w = scr.width ();
         float scale = 1.0 * w / (double)s->bounds.width ();
-        SmilTextVisitor info (w, scale, txt->props);
+        SmilTextVisitor info (w, scale, txt->props, s->background_color);
 
         Node *first = txt->firstChild ();
         for (Node *n = first; n; n = n->nextSibling ())
@@ -1157,35 +1588,7 @@ void CairoPaintVisitor::visit (SMIL::SmilText *txt) {
             int voff = 0;
             while (b) {
                 cairo_translate (cr_txt, b->rect.x() - hoff, b->rect.y() - voff);
-                QTextDocument td;
-                td.setDocumentMargin (0);
-                td.setDefaultFont (b->font);
-                bool have_alpha = (s->background_color & 0xff000000) < 0xff000000;
-                QImage img (QSize (b->rect.width(), b->rect.height()), have_alpha ? QImage::Format_ARGB32 : QImage::Format_RGB32);
-                img.fill (s->background_color);
-                td.setPageSize (QSize (b->rect.width(), b->rect.height() + 10));
-                setAlignment (td, b->align);
-                td.documentLayout()->setPaintDevice (&img);
-                td.setHtml (b->rich_text);
-                QPainter painter;
-                painter.begin (&img);
-                QAbstractTextDocumentLayout::PaintContext ctx;
-                ctx.clip = QRect (QPoint (0, 0), img.size ());
-                td.documentLayout()->draw (&painter, ctx);
-                painter.end();
-
-                cairo_surface_t *src_sf = cairo_image_surface_create_for_data (
-                        img.bits (),
-                        have_alpha ? CAIRO_FORMAT_ARGB32:CAIRO_FORMAT_RGB24,
-                        img.width(), img.height(), img.bytesPerLine ());
-                cairo_pattern_t *pat = cairo_pattern_create_for_surface (src_sf);
-                cairo_pattern_set_extend (pat, CAIRO_EXTEND_NONE);
-                cairo_set_operator (cr_txt, CAIRO_OPERATOR_SOURCE);
-                cairo_set_source (cr_txt, pat);
-                cairo_rectangle (cr_txt, 0, 0, b->rect.width(), b->rect.height());
-                cairo_fill (cr_txt);
-                cairo_pattern_destroy (pat);
-                cairo_surface_destroy (src_sf);
+                copyTextImage (cr_txt, b->image);
 
                 hoff = b->rect.x ();
                 voff = b->rect.y ();
@@ -1196,7 +1599,11 @@ void CairoPaintVisitor::visit (SMIL::SmilText *txt) {
             cairo_destroy (cr_txt);
 
             // update bounds rect
-            s->bounds = matrix.toUser (IRect (scr.point, ISize (w, info.voffset)));
+            SRect bounds = matrix.toUser (IRect (scr.point, ISize (w, info.voffset)));
+            if (bounds != s->bounds) {
+                s->bounds = bounds;
+                s->boundsChanged ();
+            }
             txt->size = s->bounds.size;
             txt->updateBounds (false);
 
@@ -1267,42 +1674,102 @@ void CairoPaintVisitor::visit (RP::Fill * fi) {
     }
 }
 
-void CairoPaintVisitor::visit (RP::Fadein * fi) {
-    if (fi->target && fi->target->id == RP::id_node_image) {
-        RP::Image *img = convertNode <RP::Image> (fi->target);
-        ImageMedia *im = img && img->media_info
-            ? static_cast <ImageMedia*> (img->media_info->media) : nullptr;
-        if (im && img->surface ()) {
-            Single sx = fi->srcx, sy = fi->srcy, sw = fi->srcw, sh = fi->srch;
-            if (!(int)sw)
-                sw = img->size.width;
-            if (!(int)sh)
-                sh = img->size.height;
-            if ((int)fi->w && (int)fi->h && (int)sw && (int)sh) {
-                if (!img->img_surface->surface)
-                    im->cached_img->copyImage (img->img_surface,
-                            img->size, cairo_surface);
-                cairo_matrix_t matrix;
-                cairo_matrix_init_identity (&matrix);
-                float scalex = 1.0 * sw / fi->w;
-                float scaley = 1.0 * sh / fi->h;
-                cairo_matrix_scale (&matrix, scalex, scaley);
-                cairo_matrix_translate (&matrix,
-                        1.0*sx/scalex - (double)fi->x,
-                        1.0*sy/scaley - (double)fi->y);
-                cairo_save (cr);
-                cairo_rectangle (cr, fi->x, fi->y, fi->w, fi->h);
-                cairo_pattern_t *pat = cairo_pattern_create_for_surface (img->img_surface->surface);
-                cairo_pattern_set_extend (pat, CAIRO_EXTEND_NONE);
-                cairo_pattern_set_matrix (pat, &matrix);
-                cairo_set_source (cr, pat);
-                cairo_clip (cr);
-                cairo_paint_with_alpha (cr, 1.0 * fi->progress / 100);
-                cairo_restore (cr);
-                cairo_pattern_destroy (pat);
-            }
-        }
+static IRect deviceRect (cairo_t *cr, Single x, Single y, Single w, Single h) {
+    double x0 = x, y0 = y, x1 = x + w, y1 = y + h;
+    cairo_user_to_device (cr, &x0, &y0);
+    cairo_user_to_device (cr, &x1, &y1);
+    int ix = (int) floor (x0 + 0.5);
+    int iy = (int) floor (y0 + 0.5);
+    return IRect (ix, iy,
+            (int) floor (x1 + 0.5) - ix, (int) floor (y1 + 0.5) - iy);
+}
+
+/**
+ * Returns a referenced copy of the src part of an RealPix image, scaled
+ * once from its img_surface to size device pixels
+ */
+static cairo_surface_t *scaledImage (ScaledImageCache *cache,
+        RP::Image *img, ImageMedia *im,
+        const SRect &src, const ISize &size, cairo_surface_t *similar) {
+    const QString key = QString::asprintf ("%p:%d:%d:%d:%d:%d:%d",
+            (void *) im->cached_img.ptr (),
+            (int) src.x (), (int) src.y (),
+            (int) src.width (), (int) src.height (),
+            size.width, size.height);
+    cairo_surface_t *cached = cache->scaled (key, im->cached_img.ptr ());
+    if (cached)
+        return cached;
+
+    if (!img->img_surface->surface)
+        im->cached_img->copyImage (img->img_surface, img->size, similar, cache);
+    cairo_surface_t *sf = cairo_surface_create_similar (similar,
+            cairo_surface_get_content (img->img_surface->surface),
+            size.width, size.height);
+    cairo_matrix_t mat;
+    cairo_matrix_init_translate (&mat, (double) src.x (), (double) src.y ());
+    cairo_matrix_scale (&mat,
+            (double) src.width () / size.width,
+            (double) src.height () / size.height);
+    cairo_pattern_t *pat = cairo_pattern_create_for_surface (img->img_surface->surface);
+    cairo_pattern_set_extend (pat, CAIRO_EXTEND_NONE);
+    cairo_pattern_set_matrix (pat, &mat);
+    cairo_t *cr = cairo_create (sf);
+    cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
+    cairo_set_source (cr, pat);
+    cairo_paint (cr);
+    cairo_destroy (cr);
+    cairo_pattern_destroy (pat);
+    cache->insert (key, im->cached_img, sf, size.width, size.height);
+    return sf;
+}
+
+/**
+ * Paints the x,y,w,h part of the target image of effect tb, when that image
+ * is placed at tx,ty with the effect's size. The image is composited
+ * unscaled at pixel aligned device coordinates, so that this is a plain
+ * blend of two buffers, for which pixman picks its SIMD implementation.
+ */
+static void paintEffectImage (cairo_t *cr, cairo_surface_t *similar,
+        ScaledImageCache *cache, RP::TimingsBase *tb, Single x, Single y, Single w, Single h,
+        Single tx, Single ty, float alpha) {
+    if (!tb->target || tb->target->id != RP::id_node_image)
+        return;
+    RP::Image *img = convertNode <RP::Image> (tb->target);
+    ImageMedia *im = img && img->media_info
+        ? static_cast <ImageMedia*> (img->media_info->media) : nullptr;
+    if (!im || !img->surface ())
+        return;
+    Single sw = tb->srcw, sh = tb->srch;
+    if (!(int)sw)
+        sw = img->size.width;
+    if (!(int)sh)
+        sh = img->size.height;
+    if (!(int)w || !(int)h || !(int)sw || !(int)sh)
+        return;
+    IRect img_rect = deviceRect (cr, tx, ty, tb->w, tb->h);
+    IRect rect = deviceRect (cr, x, y, w, h);
+    if (img_rect.isEmpty () || rect.isEmpty ())
+        return;
+    cairo_surface_t *sf = scaledImage (cache, img, im,
+            SRect (tb->srcx, tb->srcy, sw, sh), img_rect.size, similar);
+    cairo_save (cr);
+    cairo_identity_matrix (cr);
+    cairo_set_source_surface (cr, sf, img_rect.x (), img_rect.y ());
+    cairo_pattern_set_filter (cairo_get_source (cr), CAIRO_FILTER_FAST);
+    cairo_rectangle (cr, rect.x (), rect.y (), rect.width (), rect.height ());
+    if (alpha < 0.995) {
+        cairo_clip (cr);
+        cairo_paint_with_alpha (cr, alpha);
+    } else {
+        cairo_fill (cr);
     }
+    cairo_restore (cr);
+    cairo_surface_destroy (sf);
+}
+
+void CairoPaintVisitor::visit (RP::Fadein * fi) {
+    paintEffectImage (cr, cairo_surface, scaled_images, fi, fi->x, fi->y, fi->w, fi->h,
+            fi->x, fi->y, 1.0 * fi->progress / 100);
 }
 
 void CairoPaintVisitor::visit (RP::Fadeout * fo) {
@@ -1319,99 +1786,35 @@ void CairoPaintVisitor::visit (RP::Fadeout * fo) {
 }
 
 void CairoPaintVisitor::visit (RP::Crossfade * cf) {
-    if (cf->target && cf->target->id == RP::id_node_image) {
-        RP::Image *img = convertNode <RP::Image> (cf->target);
-        ImageMedia *im = img && img->media_info
-            ? static_cast <ImageMedia*> (img->media_info->media) : nullptr;
-        if (im && img->surface ()) {
-            Single sx = cf->srcx, sy = cf->srcy, sw = cf->srcw, sh = cf->srch;
-            if (!(int)sw)
-                sw = img->size.width;
-            if (!(int)sh)
-                sh = img->size.height;
-            if ((int)cf->w && (int)cf->h && (int)sw && (int)sh) {
-                if (!img->img_surface->surface)
-                    im->cached_img->copyImage (img->img_surface,
-                            img->size, cairo_surface);
-                cairo_save (cr);
-                cairo_matrix_t matrix;
-                cairo_matrix_init_identity (&matrix);
-                float scalex = 1.0 * sw / cf->w;
-                float scaley = 1.0 * sh / cf->h;
-                cairo_matrix_scale (&matrix, scalex, scaley);
-                cairo_matrix_translate (&matrix,
-                        1.0*sx/scalex - (double)cf->x,
-                        1.0*sy/scaley - (double)cf->y);
-                cairo_rectangle (cr, cf->x, cf->y, cf->w, cf->h);
-                cairo_pattern_t *pat = cairo_pattern_create_for_surface (img->img_surface->surface);
-                cairo_pattern_set_extend (pat, CAIRO_EXTEND_NONE);
-                cairo_pattern_set_matrix (pat, &matrix);
-                cairo_set_source (cr, pat);
-                cairo_clip (cr);
-                cairo_paint_with_alpha (cr, 1.0 * cf->progress / 100);
-                cairo_restore (cr);
-                cairo_pattern_destroy (pat);
-            }
-        }
-    }
+    paintEffectImage (cr, cairo_surface, scaled_images, cf, cf->x, cf->y, cf->w, cf->h,
+            cf->x, cf->y, 1.0 * cf->progress / 100);
 }
 
 void CairoPaintVisitor::visit (RP::Wipe * wipe) {
-    if (wipe->target && wipe->target->id == RP::id_node_image) {
-        RP::Image *img = convertNode <RP::Image> (wipe->target);
-        ImageMedia *im = img && img->media_info
-            ? static_cast <ImageMedia*> (img->media_info->media) : nullptr;
-        if (im && img->surface ()) {
-            Single x = wipe->x, y = wipe->y;
-            Single tx = x, ty = y;
-            Single w = wipe->w, h = wipe->h;
-            Single sx = wipe->srcx, sy = wipe->srcy, sw = wipe->srcw, sh = wipe->srch;
-            if (!(int)sw)
-                sw = img->size.width;
-            if (!(int)sh)
-                sh = img->size.height;
-            if (wipe->direction == RP::Wipe::dir_right) {
-                Single dx = w * 1.0 * wipe->progress / 100;
-                tx = x -w + dx;
-                w = dx;
-            } else if (wipe->direction == RP::Wipe::dir_left) {
-                Single dx = w * 1.0 * wipe->progress / 100;
-                tx = x + w - dx;
-                x = tx;
-                w = dx;
-            } else if (wipe->direction == RP::Wipe::dir_down) {
-                Single dy = h * 1.0 * wipe->progress / 100;
-                ty = y - h + dy;
-                h = dy;
-            } else if (wipe->direction == RP::Wipe::dir_up) {
-                Single dy = h * 1.0 * wipe->progress / 100;
-                ty = y + h - dy;
-                y = ty;
-                h = dy;
-            }
-
-            if ((int)w && (int)h) {
-                if (!img->img_surface->surface)
-                    im->cached_img->copyImage (img->img_surface,
-                            img->size, cairo_surface);
-                cairo_matrix_t matrix;
-                cairo_matrix_init_identity (&matrix);
-                float scalex = 1.0 * sw / wipe->w;
-                float scaley = 1.0 * sh / wipe->h;
-                cairo_matrix_scale (&matrix, scalex, scaley);
-                cairo_matrix_translate (&matrix,
-                        1.0*sx/scalex - (double)tx,
-                        1.0*sy/scaley - (double)ty);
-                cairo_pattern_t *pat = cairo_pattern_create_for_surface (img->img_surface->surface);
-                cairo_pattern_set_extend (pat, CAIRO_EXTEND_NONE);
-                cairo_pattern_set_matrix (pat, &matrix);
-                cairo_set_source (cr, pat);
-                cairo_rectangle (cr, x, y, w, h);
-                cairo_fill (cr);
-                cairo_pattern_destroy (pat);
-            }
-        }
-    }
+    Single x = wipe->x, y = wipe->y;
+    Single tx = x, ty = y;
+    Single w = wipe->w, h = wipe->h;
+    if (wipe->direction == RP::Wipe::dir_right) {
+        Single dx = w * 1.0 * wipe->progress / 100;
+        tx = x -w + dx;
+        w = dx;
+    } else if (wipe->direction == RP::Wipe::dir_left) {
+        Single dx = w * 1.0 * wipe->progress / 100;
+        tx = x + w - dx;
+        x = tx;
+        w = dx;
+    } else if (wipe->direction == RP::Wipe::dir_down) {
+        Single dy = h * 1.0 * wipe->progress / 100;
+        ty = y - h + dy;
+        h = dy;
+    } else if (wipe->direction == RP::Wipe::dir_up) {
+        Single dy = h * 1.0 * wipe->progress / 100;
+        ty = y + h - dy;
+        y = ty;
+        h = dy;
+    }
+
+    paintEffectImage (cr, cairo_surface, scaled_images, wipe, x, y, w, h, tx, ty, 1.0);
 }
 
 void CairoPaintVisitor::visit (RP::ViewChange * vc) {
@@ -1453,6 +1856,7 @@ class MouseVisitor : public Visitor
     Matrix matrix;
     NodePtrW source;
     const MessageType event;
+    const QSet <Surface *> *candidates; // if set, the others can't be hit
     int x, y;
     bool handled;
     bool bubble_up;
@@ -1460,7 +1864,8 @@ class MouseVisitor : public Visitor
     bool deliverAndForward (Node *n, Surface *s, bool inside, bool deliver);
     void surfaceEvent (Node *mt, Surface *s);
 public:
-    MouseVisitor (ViewArea *v, MessageType evt, Matrix m, int x, int y);
+    MouseVisitor (ViewArea *v, MessageType evt, Matrix m, int x, int y,
+            const QSet <Surface *> *candidates=nullptr);
     ~MouseVisitor () override {}
     using Visitor::visit;
     void visit (Node * n) override;
@@ -1477,8 +1882,9 @@ public:
 
 } // namespace
 
-MouseVisitor::MouseVisitor (ViewArea *v, MessageType evt, Matrix m, int a, int b)
-  : view_area (v), matrix (m), event (evt), x (a), y (b),
+MouseVisitor::MouseVisitor (ViewArea *v, MessageType evt, Matrix m,
+        int a, int b, const QSet <Surface *> *c)
+  : view_area (v), matrix (m), event (evt), candidates (c), x (a), y (b),
     handled (false), bubble_up (false) {
 }
 
@@ -1498,7 +1904,7 @@ void MouseVisitor::visit (SMIL::Layout * layout) {
 
 void MouseVisitor::visit (SMIL::RegionBase *region) {
     Surface *s = (Surface *) region->role (RoleDisplay);
-    if (s) {
+    if (s && (!candidates || candidates->contains (s))) {
         SRect rect = s->bounds;
         IRect scr = matrix.toScreen (rect);
         int rx = scr.x(), ry = scr.y(), rw = scr.width(), rh = scr.height();
@@ -1518,6 +1924,8 @@ void MouseVisitor::visit (SMIL::RegionBase *region) {
             else if (knob_y + knob_h > sbh)
                 knob_y = sbh - knob_h;
             s->y_scroll = vy * knob_y / sbh;
+            s->invalidate ();
+            s->boundsChanged ();
             view_area->scheduleRepaint (scr);
             return;
         }
@@ -1532,6 +1940,8 @@ void MouseVisitor::visit (SMIL::RegionBase *region) {
             else if (knob_x + knob_w > sbw)
                 knob_x = sbw - knob_w;
             s->x_scroll = vw * knob_x / sbw;
+            s->invalidate ();
+            s->boundsChanged ();
             view_area->scheduleRepaint (scr);
             return;
         }
@@ -1546,17 +1956,19 @@ void MouseVisitor::visit (SMIL::RegionBase *region) {
         bubble_up = false;
 
         bool child_handled = false;
-        if (inside || s->has_mouse)
-            for (SurfacePtr c = s->firstChild (); c; c = c->nextSibling ()) {
-                if (c->node && c->node->id == SMIL::id_node_region) {
+        if (inside || s->has_mouse) {
+            const Surface::ZOrderMap children = s->z_children;
+            const Surface::ZOrderMap::const_iterator e = children.constEnd ();
+            for (Surface::ZOrderMap::const_iterator i = children.constBegin (); i != e; ++i) {
+                SurfacePtr c = i.value ();
+                if (c && c->node && c->node->id == SMIL::id_node_region) {
                     c->node->accept (this);
                     child_handled |= handled;
                     if (!source || !source->active ())
                         break;
-                } else {
-                    break;
                 }
             }
+        }
         child_handled &= !bubble_up;
         bubble_up = false;
         if (source && source->active ())
@@ -1705,6 +2117,8 @@ void MouseVisitor::surfaceEvent (Node *node, Surface *s) {
         s->node->accept (this);
         return;
     }
+    if (candidates && !candidates->contains (s))
+        return;
     SRect rect = s->bounds;
     IRect scr = matrix.toScreen (rect);
     int rx = scr.x(), ry = scr.y(), rw = scr.width(), rh = scr.height();
@@ -1734,6 +2148,284 @@ void MouseVisitor::visit (SMIL::SmilText *st) {
 
 //-----------------------------------------------------------------------------
 
+namespace {
+
+/*
+ * Screen rectangles of the pointer targets MouseVisitor would test, in a
+ * uniform grid. A pointer move that doesn't change the set of targets under
+ * the pointer can't cause in/out bounds events nor another cursor, so the
+ * walk is skipped. Otherwise only the surfaces under the pointer and those
+ * that had it are visited. The index is rebuilt when surface geometry or
+ * the surface tree changed, see Surface::boundsChanged.
+ */
+class HitIndex
+{
+public:
+    HitIndex ()
+     : columns (0), rows (0), width (0), height (0), generation (0),
+       valid (false), last_valid (false) {}
+
+    bool upToDate (Node *root, unsigned int gen, int w, int h) const {
+        return valid && generation == gen && root_node.ptr () == root
+            && w == width && h == height;
+    }
+    void build (Node *root, unsigned int gen, const Matrix &m, int w, int h);
+    void add (const IRect &rect, Surface *s, bool fine);
+    bool hits (int x, int y, QVector <int> &result) const;
+    void candidates (const QVector <int> &hits, QSet <Surface *> &result) const;
+
+    struct Entry {
+        IRect rect;
+        SurfacePtrW surface;
+        bool fine; // only the full walk can tell, eg. for an <area>
+    };
+    static const int CellSize = 64;
+
+    QVector <Entry> entries;
+    QVector <QVector <int> > cells;
+    NodePtrW root_node;
+    int columns, rows, width, height;
+    unsigned int generation;
+    bool valid;
+
+    // outcome of the last full walk
+    QVector <int> last_hits;
+    QCursor last_cursor;
+    bool last_valid;
+};
+
+/* Mirrors the MouseVisitor traversal, without pruning and delivering */
+class HitIndexVisitor : public Visitor
+{
+    HitIndex *index;
+    Matrix matrix;
+
+    void forward (Node *node);
+    void surface (Node *node, Surface *s);
+public:
+    HitIndexVisitor (HitIndex *i, const Matrix &m) : index (i), matrix (m) {}
+    using Visitor::visit;
+    void visit (SMIL::Smil *) override;
+    void visit (SMIL::Layout *) override;
+    void visit (SMIL::RegionBase *) override;
+    void visit (SMIL::MediaType *) override;
+    void visit (SMIL::SmilText *) override;
+    void visit (SMIL::Area *) override;
+};
+
+void HitIndexVisitor::visit (SMIL::Smil *s) {
+    if (s->active () && s->layout_node)
+        s->layout_node->accept (this);
+}
+
+void HitIndexVisitor::visit (SMIL::Layout *layout) {
+    if (layout->root_layout)
+        layout->root_layout->accept (this);
+}
+
+void HitIndexVisitor::visit (SMIL::RegionBase *region) {
+    Surface *s = (Surface *) region->role (RoleDisplay);
+    if (!s)
+        return;
+    SRect rect = s->bounds;
+    index->add (matrix.toScreen (rect), s, false);
+
+    Matrix m = matrix;
+    matrix = Matrix (rect.x(), rect.y(), 1.0, 1.0);
+    matrix.transform (m);
+    if (!s->virtual_size.isEmpty ())
+        matrix.translate (-s->x_scroll, -s->y_scroll);
+    const Surface::ZOrderMap children = s->z_children;
+    const Surface::ZOrderMap::const_iterator e = children.constEnd ();
+    for (Surface::ZOrderMap::const_iterator i = children.constBegin (); i != e; ++i) {
+        SurfacePtr c = i.value ();
+        if (c && c->node && c->node->id == SMIL::id_node_region)
+            c->node->accept (this);
+    }
+    forward (region);
+    matrix = m;
+}
+
+void HitIndexVisitor::visit (SMIL::MediaType *mt) {
+    if (mt->sensitivity != SMIL::MediaType::sens_transparent)
+        surface (mt, mt->surface ());
+}
+
+void HitIndexVisitor::visit (SMIL::SmilText *st) {
+    surface (st, st->surface ());
+}
+
+void HitIndexVisitor::visit (SMIL::Area *area) {
+    Surface *s = (Surface *) area->parentNode ()->role (RoleDisplay);
+    if (s)
+        index->add (matrix.toScreen (s->bounds), s, true);
+}
+
+void HitIndexVisitor::forward (Node *node) {
+    ConnectionList *nl = nodeMessageReceivers (node, MsgSurfaceAttach);
+    if (nl)
+        for (Connection *c = nl->first(); c; c = nl->next ())
+            if (c->connecter)
+                c->connecter->accept (this);
+}
+
+void HitIndexVisitor::surface (Node *node, Surface *s) {
+    if (!s)
+        return;
+    if (s->node && s->node.ptr () != node) {
+        s->node->accept (this);
+        return;
+    }
+    SRect rect = s->bounds;
+    index->add (matrix.toScreen (rect), s, false);
+    forward (node);
+    if (s->firstChild () && s->firstChild ()->node) {
+        Matrix m = matrix;
+        matrix = Matrix (rect.x(), rect.y(), s->xscale, s->yscale);
+        matrix.transform (m);
+        s->firstChild ()->node->accept (this);
+        matrix = m;
+    }
+}
+
+void HitIndex::build (Node *root, unsigned int gen, const Matrix &m,
+        int w, int h) {
+    entries.clear ();
+    width = w;
+    height = h;
+    columns = (w + CellSize - 1) / CellSize;
+    rows = (h + CellSize - 1) / CellSize;
+    cells.fill (QVector <int> (), columns * rows);
+    HitIndexVisitor visitor (this, m);
+    root->accept (&visitor);
+    root_node = root;
+    generation = gen;
+    valid = true;
+    last_valid = false;
+}
+
+void HitIndex::add (const IRect &rect, Surface *s, bool fine) {
+    Entry entry;
+    entry.rect = rect;
+    entry.surface = s;
+    entry.fine = fine;
+    entries.append (entry);
+    IRect r = rect.intersect (IRect (0, 0, width, height));
+    if (r.isEmpty ())
+        return;
+    int c0 = r.x () / CellSize;
+    int c1 = (r.x () + r.width () - 1) / CellSize;
+    int r0 = r.y () / CellSize;
+    int r1 = (r.y () + r.height () - 1) / CellSize;
+    for (int row = r0; row <= r1; ++row)
+        for (int col = c0; col <= c1; ++col)
+            cells[row * columns + col].append (entries.size () - 1);
+}
+
+/* Returns false if only the full walk can tell what's under x,y */
+bool HitIndex::hits (int x, int y, QVector <int> &result) const {
+    result.clear ();
+    if (x < 0 || y < 0 || x >= width || y >= height)
+        return false;
+    for (int i : cells[(y / CellSize) * columns + x / CellSize]) {
+        const IRect &r = entries[i].rect;
+        if (x > r.x () && x < r.x () + r.width () &&
+                y > r.y () && y < r.y () + r.height ()) {
+            if (entries[i].fine)
+                return false;
+            result.append (i);
+        }
+    }
+    return true;
+}
+
+/* The surfaces a pointer move can reach: hit now or had the pointer */
+void HitIndex::candidates (const QVector <int> &hits,
+        QSet <Surface *> &result) const {
+    result.clear ();
+    for (int i : hits)
+        if (entries[i].surface)
+            result.insert (entries[i].surface.ptr ());
+    for (const Entry &entry : entries)
+        if (entry.surface && entry.surface->has_mouse)
+            result.insert (entry.surface.ptr ());
+}
+
+} // namespace
+
+//-----------------------------------------------------------------------------
+
+static int rectArea (const IRect &r) {
+    return r.isEmpty () ? 0 : r.width () * r.height ();
+}
+
+void DamageRegion::add (const IRect &r) {
+    if (r.isEmpty ())
+        return;
+    IRect rect = r;
+    for (int i = 0; i < rects.size (); ) {
+        IRect u = rects[i].unite (rect);
+        if (!rects[i].intersect (rect).isEmpty () ||
+                4 * rectArea (u) <= 5 * (rectArea (rects[i]) + rectArea (rect))) {
+            // keep the rectangles disjoint, a grown one may hit earlier ones
+            rect = u;
+            rects.remove (i);
+            i = 0;
+        } else {
+            ++i;
+        }
+    }
+    if (rects.size () >= MaxRects) {
+        int best = 0;
+        int best_waste = -1;
+        for (int i = 0; i < rects.size (); ++i) {
+            int waste = rectArea (rects[i].unite (rect)) - rectArea (rects[i]);
+            if (best_waste < 0 || waste < best_waste) {
+                best = i;
+                best_waste = waste;
+            }
+        }
+        IRect u = rects[best].unite (rect);
+        rects.remove (best);
+        add (u);
+        return;
+    }
+    rects.append (rect);
+}
+
+DamageRegion DamageRegion::intersect (const IRect &rect) const {
+    DamageRegion region;
+    for (int i = 0; i < rects.size (); ++i) {
+        IRect r = rects[i].intersect (rect);
+        if (!r.isEmpty ())
+            region.rects.append (r);
+    }
+    return region;
+}
+
+DamageRegion DamageRegion::unite (const DamageRegion &r) const {
+    DamageRegion region = *this;
+    for (int i = 0; i < r.rects.size (); ++i)
+        region.add (r.rects[i]);
+    return region;
+}
+
+IRect DamageRegion::bounds () const {
+    IRect rect;
+    for (int i = 0; i < rects.size (); ++i)
+        rect = rect.unite (rects[i]);
+    return rect;
+}
+
+int DamageRegion::area () const {
+    int a = 0;
+    for (int i = 0; i < rects.size (); ++i)
+        a += rectArea (rects[i]);
+    return a;
+}
+
+//-----------------------------------------------------------------------------
+
 namespace KMPlayer {
 class ViewerAreaPrivate
 {
@@ -1741,6 +2433,14 @@ public:
     ViewerAreaPrivate (ViewArea *v)
         : m_view_area (v), backing_store (0), gc(0),
           screen(nullptr), visual(nullptr), width(0), height(0)
+#ifdef KMPLAYER_WITH_CAIRO
+          , merge_target (nullptr)
+#endif
+#ifdef KMPLAYER_WITH_XCB_SHM
+          , shm_seg (0), shm_data (nullptr), shm_surface (nullptr),
+          shm_event_base (0), shm_failed (false), shm_busy (false),
+          frame_deferred (false)
+#endif
     {}
     ~ViewerAreaPrivate() {
         destroyBackingStore ();
@@ -1773,6 +2473,11 @@ public:
     cairo_surface_t *createSurface (int w, int h) {
         xcb_connection_t* connection = QX11Info::connection();
         destroyBackingStore ();
+#ifdef KMPLAYER_WITH_XCB_SHM
+        cairo_surface_t *shm_sf = createShmSurface (w, h);
+        if (shm_sf)
+            return shm_sf;
+#endif
         xcb_screen_t* scr = screen_of_display(connection, QX11Info::appScreen());
         backing_store = xcb_generate_id(connection);
         xcb_void_cookie_t cookie = xcb_create_pixmap_checked(connection, scr->root_depth, backing_store, m_view_area->winId(), w, h);
@@ -1783,27 +2488,191 @@ public:
         }
         return cairo_xcb_surface_create(connection, backing_store, visual_of_screen(connection, scr), w, h);
     }
-    void swapBuffer (const IRect &sr, int dx, int dy) {
+#ifdef KMPLAYER_WITH_XCB_SHM
+    /**
+     * Client side backing store in a shared memory segment, so that painting
+     * images and text does not send their pixels over the X connection.
+     * Returns null when the display cannot share memory with us, eg. when
+     * it is remote, or when its pixel layout differs from cairo's RGB24.
+     */
+    cairo_surface_t *createShmSurface (int w, int h) {
+        if (shm_failed)
+            return nullptr;
+        xcb_connection_t* connection = QX11Info::connection();
+        xcb_screen_t* scr = screen_of_display(connection, QX11Info::appScreen());
+        xcb_visualtype_t* vis = visual_of_screen(connection, scr);
+        const xcb_query_extension_reply_t *ext =
+            xcb_get_extension_data(connection, &xcb_shm_id);
+        const uint8_t byte_order = Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+            ? XCB_IMAGE_ORDER_LSB_FIRST : XCB_IMAGE_ORDER_MSB_FIRST;
+        if (!ext || !ext->present || !vis ||
+                (scr->root_depth != 24 && scr->root_depth != 32) ||
+                vis->red_mask != 0xff0000 || vis->green_mask != 0xff00 ||
+                vis->blue_mask != 0xff ||
+                xcb_get_setup(connection)->image_byte_order != byte_order) {
+            qCDebug(LOG_KMPLAYER_COMMON) << "MIT-SHM not usable, using pixmap";
+            shm_failed = true;
+            return nullptr;
+        }
+        int stride = cairo_format_stride_for_width (CAIRO_FORMAT_RGB24, w);
+        int id = shmget (IPC_PRIVATE, stride * h, IPC_CREAT | 0600);
+        if (id < 0)
+            return nullptr;
+        void *data = shmat (id, nullptr, 0);
+        if (data == (void *) -1) {
+            shmctl (id, IPC_RMID, nullptr);
+            return nullptr;
+        }
+        xcb_shm_seg_t seg = xcb_generate_id(connection);
+        xcb_generic_error_t* error = xcb_request_check(connection,
+                xcb_shm_attach_checked(connection, seg, id, 0));
+        shmctl (id, IPC_RMID, nullptr); // freed after both detached
+        if (error) {
+            qCDebug(LOG_KMPLAYER_COMMON) << "MIT-SHM attach failed, using pixmap";
+            free(error);
+            shmdt (data);
+            shm_failed = true;
+            return nullptr;
+        }
+        shm_seg = seg;
+        shm_event_base = ext->first_event;
+        shm_data = (unsigned char *) data;
+        shm_surface = cairo_image_surface_create_for_data (shm_data,
+                CAIRO_FORMAT_RGB24, w, h, stride);
+        shm_width = w;
+        shm_height = h;
+        return shm_surface;
+    }
+#endif
+    void swapBuffer (const DamageRegion &region) {
+        if (region.isEmpty ())
+            return;
         xcb_connection_t* connection = QX11Info::connection();
         if (!gc) {
             gc = xcb_generate_id(connection);
             uint32_t values[] = { XCB_GX_COPY, XCB_FILL_STYLE_SOLID,
                 XCB_SUBWINDOW_MODE_CLIP_BY_CHILDREN, 0 };
-            xcb_create_gc(connection, gc, backing_store,
+            xcb_create_gc(connection, gc, m_view_area->winId(),
                     XCB_GC_FUNCTION | XCB_GC_FILL_STYLE |
                     XCB_GC_SUBWINDOW_MODE | XCB_GC_GRAPHICS_EXPOSURES, values);
         }
-        xcb_copy_area(connection, backing_store, m_view_area->winId(),
-                gc, sr.x(), sr.y(), dx, dy, sr.width (), sr.height ());
+#ifdef KMPLAYER_WITH_XCB_SHM
+        if (shm_surface) {
+            cairo_surface_flush (shm_surface);
+            xcb_screen_t* scr = screen_of_display(connection, QX11Info::appScreen());
+            for (int i = 0; i < region.rects.size (); ++i) {
+                const IRect &sr = region.rects[i];
+                // the server reads the segment asynchronously, the last
+                // put reports when it's done with all of them
+                const uint8_t send_event = i + 1 == region.rects.size ();
+                xcb_shm_put_image(connection, m_view_area->winId(), gc,
+                        shm_width, shm_height, sr.x(), sr.y(),
+                        sr.width (), sr.height (), sr.x(), sr.y(),
+                        scr->root_depth, XCB_IMAGE_FORMAT_Z_PIXMAP,
+                        send_event, shm_seg, 0);
+            }
+            xcb_flush(connection);
+            shm_busy = true;
+            shm_put_clock.start ();
+            return;
+        }
+#endif
+        for (int i = 0; i < region.rects.size (); ++i) {
+            const IRect &sr = region.rects[i];
+            xcb_copy_area(connection, backing_store, m_view_area->winId(),
+                    gc, sr.x(), sr.y(), sr.x(), sr.y(), sr.width (), sr.height ());
+        }
         xcb_flush(connection);
     }
+    /**
+     * Keeps the merged repaints of a frame, painted in full onto target
+     * once the server no longer reads from it
+     */
+    void addMerge (cairo_surface_t *target, cairo_pattern_t *pattern,
+            cairo_surface_t *surface, const IRect &rect) {
+        PendingMerge merge;
+        merge.pattern = pattern;
+        merge.surface = surface;
+        merge.rect = rect;
+        merge_target = target;
+        pending_merges.append (merge);
+    }
+    void applyMerges () {
+        if (pending_merges.isEmpty () || presentPending ())
+            return;
+        cairo_t *cr = cairo_create (merge_target);
+        cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
+        for (int i = 0; i < pending_merges.size (); ++i) {
+            const IRect &r = pending_merges[i].rect;
+            cairo_set_source (cr, pending_merges[i].pattern);
+            cairo_rectangle (cr, r.x (), r.y (), r.width (), r.height ());
+            cairo_fill (cr);
+        }
+        cairo_destroy (cr);
+        cairo_surface_flush (merge_target);
+        dropMerges ();
+    }
+    void dropMerges () {
+        for (int i = 0; i < pending_merges.size (); ++i) {
+            const IRect &r = pending_merges[i].rect;
+            cairo_pattern_destroy (pending_merges[i].pattern);
+            surface_pool.release (pending_merges[i].surface,
+                    r.width (), r.height ());
+        }
+        pending_merges.clear ();
+        merge_target = nullptr;
+    }
+#endif
+    /**
+     * Whether the server may still read the shared memory backing store,
+     * which must not be painted in meanwhile
+     */
+    bool presentPending () {
+#ifdef KMPLAYER_WITH_XCB_SHM
+        if (shm_busy && shm_put_clock.elapsed () > 500) {
+            // completion lost, eg. the window went away meanwhile
+            xcb_connection_t* connection = QX11Info::connection();
+            free(xcb_get_input_focus_reply(connection,
+                        xcb_get_input_focus(connection), nullptr));
+            shm_busy = false;
+            applyMerges ();
+        }
+        return shm_busy;
+#else
+        return false;
+#endif
+    }
+#ifdef KMPLAYER_WITH_XCB_SHM
+    /* True for the completion of our last put, the segment is ours again */
+    bool shmCompleted (xcb_generic_event_t *event) {
+        if (!shm_busy || (event->response_type & ~0x80) !=
+                shm_event_base + XCB_SHM_COMPLETION)
+            return false;
+        xcb_shm_completion_event_t *ev = (xcb_shm_completion_event_t *) event;
+        if (ev->shmseg != shm_seg)
+            return false;
+        shm_busy = false;
+        applyMerges ();
+        return true;
+    }
 #endif
     void destroyBackingStore () {
 #ifdef KMPLAYER_WITH_CAIRO
+        dropMerges ();
         if (backing_store) {
             xcb_connection_t* connection = QX11Info::connection();
             xcb_free_pixmap(connection, backing_store);
         }
+#endif
+#ifdef KMPLAYER_WITH_XCB_SHM
+        if (shm_data) {
+            xcb_connection_t* connection = QX11Info::connection();
+            xcb_shm_detach(connection, shm_seg);
+            shmdt (shm_data);
+            shm_data = nullptr;
+            shm_surface = nullptr;
+            shm_busy = false;
+        }
 #endif
         backing_store = 0;
     }
@@ -1847,6 +2716,30 @@ public:
     xcb_visualtype_t* visual;
     int width;
     int height;
+    HitIndex hit_index;
+#ifdef KMPLAYER_WITH_CAIRO
+    struct PendingMerge {
+        cairo_pattern_t *pattern;
+        cairo_surface_t *surface;
+        IRect rect;
+    };
+    SurfacePool surface_pool;
+    ScaledImageCache scaled_images;
+    QVector <PendingMerge> pending_merges;
+    cairo_surface_t *merge_target;
+#endif
+#ifdef KMPLAYER_WITH_XCB_SHM
+    xcb_shm_seg_t shm_seg;
+    unsigned char *shm_data;
+    cairo_surface_t *shm_surface;  // owned by the root Surface
+    QElapsedTimer shm_put_clock;
+    int shm_width;
+    int shm_height;
+    uint8_t shm_event_base;
+    bool shm_failed;
+    bool shm_busy;                 // server still reads shm_data
+    bool frame_deferred;           // a frame waits for shm_busy to clear
+#endif
 };
 
 class RepaintUpdater
@@ -1870,10 +2763,14 @@ ViewArea::ViewArea (QWidget *, View * view, bool paint_bg)
    m_mouse_invisible_timer (0),
    m_repaint_timer (0),
    m_restore_fullscreen_timer (0),
+   m_next_frame (0),
+   m_surface_generation (0),
    m_fullscreen (false),
    m_minimal (false),
    m_updaters_enabled (true),
-   m_paint_background (paint_bg) {
+   m_paint_background (paint_bg),
+   m_in_frame (false),
+   m_frame_wanted (false) {
     if (!paint_bg)
         setAttribute (Qt::WA_NoSystemBackground, true);
     QPalette palette;
@@ -1969,6 +2866,7 @@ void ViewArea::mousePressEvent (QMouseEvent * e) {
                     surface->xscale, surface->yscale),
                 devicex, devicey);
         surface->node->accept (&visitor);
+        d->hit_index.last_valid = false;
     }
 }
 
@@ -1982,12 +2880,27 @@ void ViewArea::mouseMoveEvent (QMouseEvent * e) {
     if (surface->node) {
         int devicex = (int)(e->x() * devicePixelRatioF());
         int devicey = (int)(e->y() * devicePixelRatioF());
-        MouseVisitor visitor (this, MsgEventPointerMoved,
-                Matrix (surface->bounds.x (), surface->bounds.y (),
-                    surface->xscale, surface->yscale),
-                devicex, devicey);
-        surface->node->accept (&visitor);
-        setCursor (visitor.cursor);
+        int w = (int)(width() * devicePixelRatioF());
+        int h = (int)(height() * devicePixelRatioF());
+        Matrix m (surface->bounds.x (), surface->bounds.y (),
+                surface->xscale, surface->yscale);
+        HitIndex &index = d->hit_index;
+        if (!index.upToDate (surface->node, m_surface_generation, w, h))
+            index.build (surface->node, m_surface_generation, m, w, h);
+        QVector <int> hits;
+        bool known = index.hits (devicex, devicey, hits);
+        if (!known || !index.last_valid || hits != index.last_hits) {
+            QSet <Surface *> candidates;
+            if (known)
+                index.candidates (hits, candidates);
+            MouseVisitor visitor (this, MsgEventPointerMoved, m,
+                    devicex, devicey, known ? &candidates : nullptr);
+            surface->node->accept (&visitor);
+            setCursor (visitor.cursor);
+            index.last_hits = hits;
+            index.last_cursor = visitor.cursor;
+            index.last_valid = known;
+        }
     }
     e->accept ();
     mouseMoved (); // for m_mouse_invisible_timer
@@ -1997,78 +2910,87 @@ void ViewArea::syncVisual () {
     pixel_device_ratio = devicePixelRatioF();
     int w = (int)(width() * devicePixelRatioF());
     int h = (int)(height() * devicePixelRatioF());
-    IRect rect = m_repaint_rect.intersect (IRect (0, 0, w, h));
+    DamageRegion region = m_repaint_rect.intersect (IRect (0, 0, w, h));
+    paint_frame++;
+    m_frame_stats.painted_pixels += region.area ();
 #ifdef KMPLAYER_WITH_CAIRO
     if (surface->node) {
-        int ex = rect.x ();
-        if (ex > 0)
-            ex--;
-        int ey = rect.y ();
-        if (ey > 0)
-            ey--;
-        int ew = rect.width () + 2;
-        int eh = rect.height () + 2;
-        IRect swap_rect;
-        cairo_surface_t *merge = nullptr;
-        cairo_pattern_t *pat = nullptr;
+        DamageRegion swap_region;
+        QVector <cairo_pattern_t *> merges;
+        QVector <cairo_surface_t *> merge_surfaces;
         cairo_t *cr = nullptr;
         if (!surface->surface) {
             surface->surface = d->createSurface(w, h);
-            swap_rect = IRect (ex, ey, ew, eh);
-            CairoPaintVisitor visitor (surface->surface,
-                    Matrix (surface->bounds.x(), surface->bounds.y(),
-                        surface->xscale, surface->yscale),
-                    swap_rect,
-                    palette ().color (backgroundRole ()), true);
-            surface->node->accept (&visitor);
-            m_update_rect = IRect ();
-        } else if (!rect.isEmpty ()) {
-            merge = cairo_surface_create_similar (surface->surface,
-                    CAIRO_CONTENT_COLOR, ew, eh);
-            {
-                CairoPaintVisitor visitor (merge,
-                        Matrix (surface->bounds.x()-ex, surface->bounds.y()-ey,
+            swap_region = region;
+            for (int i = 0; i < region.rects.size (); ++i) {
+                CairoPaintVisitor visitor (surface->surface, &d->surface_pool,
+                        &d->scaled_images,
+                        Matrix (surface->bounds.x(), surface->bounds.y(),
                             surface->xscale, surface->yscale),
-                        IRect (0, 0, ew, eh),
+                        region.rects[i],
                         palette ().color (backgroundRole ()), true);
                 surface->node->accept (&visitor);
             }
+            m_update_rect.clear ();
+        } else if (!region.isEmpty ()) {
             cr = cairo_create (surface->surface);
-            pat = cairo_pattern_create_for_surface (merge);
-            cairo_pattern_set_extend (pat, CAIRO_EXTEND_NONE);
-            cairo_matrix_t mat;
-            cairo_matrix_init_translate (&mat, (int) -ex, (int) -ey);
-            cairo_pattern_set_matrix (pat, &mat);
-            cairo_set_source (cr, pat);
-            //cairo_set_operator (cr, CAIRO_OPERATOR_ADD);
-            cairo_rectangle (cr, ex, ey, ew, eh);
-            //cairo_fill (cr);
-            cairo_clip (cr);
-            cairo_paint_with_alpha (cr, .8);
-            swap_rect = IRect (ex, ey, ew, eh).unite (m_update_rect);
-            m_update_rect = IRect (ex, ey, ew, eh);
+            for (int i = 0; i < region.rects.size (); ++i) {
+                const IRect &r = region.rects[i];
+                cairo_surface_t *merge = d->surface_pool.acquire (
+                        surface->surface, CAIRO_CONTENT_COLOR,
+                        r.width (), r.height ());
+                {
+                    CairoPaintVisitor visitor (merge, &d->surface_pool,
+                            &d->scaled_images,
+                            Matrix (surface->bounds.x()-r.x(),
+                                surface->bounds.y()-r.y(),
+                                surface->xscale, surface->yscale),
+                            IRect (0, 0, r.width (), r.height ()),
+                            palette ().color (backgroundRole ()), true);
+                    surface->node->accept (&visitor);
+                }
+                cairo_pattern_t *pat = cairo_pattern_create_for_surface (merge);
+                cairo_pattern_set_extend (pat, CAIRO_EXTEND_NONE);
+                cairo_matrix_t mat;
+                cairo_matrix_init_translate (&mat, -r.x (), -r.y ());
+                cairo_pattern_set_matrix (pat, &mat);
+                cairo_save (cr);
+                cairo_set_source (cr, pat);
+                cairo_rectangle (cr, r.x (), r.y (), r.width (), r.height ());
+                cairo_clip (cr);
+                cairo_paint_with_alpha (cr, .8);
+                cairo_restore (cr);
+                merges.append (pat);
+                merge_surfaces.append (merge);
+            }
+            swap_region = region.unite (m_update_rect);
+            m_update_rect = region;
         } else {
-            swap_rect = m_update_rect;
-            m_update_rect = IRect ();
+            swap_region = m_update_rect;
+            m_update_rect.clear ();
         }
-        d->swapBuffer (swap_rect, swap_rect.x (), swap_rect.y ());
-        if (merge) {
-            cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
-            cairo_rectangle (cr, ex, ey, ew, eh);
-            cairo_fill (cr);
+        d->swapBuffer (swap_region);
+        if (cr) {
             cairo_destroy (cr);
-            cairo_pattern_destroy (pat);
-            cairo_surface_destroy (merge);
+            for (int i = 0; i < merges.size (); ++i)
+                d->addMerge (surface->surface, merges[i], merge_surfaces[i],
+                        region.rects[i]);
+            d->applyMerges (); // else when the server is done reading
         }
         cairo_surface_flush (surface->surface);
     } else
 #endif
     {
-        m_update_rect = IRect ();
-        repaint(QRect(rect.x() / devicePixelRatioF(),
-                      rect.y() / devicePixelRatioF(),
-                      rect.width() / devicePixelRatioF(),
-                      rect.height() / devicePixelRatioF()));
+        m_update_rect.clear ();
+        QRegion qregion;
+        for (int i = 0; i < region.rects.size (); ++i) {
+            const IRect &r = region.rects[i];
+            qregion += QRect (r.x() / devicePixelRatioF(),
+                    r.y() / devicePixelRatioF(),
+                    r.width() / devicePixelRatioF(),
+                    r.height() / devicePixelRatioF());
+        }
+        repaint (qregion);
     }
 }
 
@@ -2218,20 +3140,51 @@ void ViewArea::mouseMoved () {
 }
 
 void ViewArea::scheduleRepaint (const IRect &rect) {
-    if (m_repaint_timer) {
-        m_repaint_rect = m_repaint_rect.unite (rect);
-    } else {
-        m_repaint_rect = rect;
-        m_repaint_timer = startTimer (25);
-    }
+    // one pixel margin for anti-aliased edges
+    if (!rect.isEmpty ())
+        m_repaint_rect.add (IRect (rect.x () - 1, rect.y () - 1,
+                    rect.width () + 2, rect.height () + 2));
+    scheduleFrame ();
 }
 
 ConnectionList *ViewArea::updaters () {
-    if (!m_repaint_timer)
-        m_repaint_timer = startTimer (25);
+    scheduleFrame ();
     return &m_updaters;
 }
 
+/**
+ * Duration of a display refresh, frames are painted at this rate while
+ * updaters are active
+ */
+int ViewArea::frameInterval () const {
+    QWindow *win = window ()->windowHandle ();
+    QScreen *scr = win ? win->screen () : QGuiApplication::primaryScreen ();
+    qreal rate = scr ? scr->refreshRate () : 0.0;
+    return rate > 1.0 ? qBound (4, qRound (1000.0 / rate), 40) : 16;
+}
+
+/**
+ * Starts the frame timer for the next refresh slot. When the view was idle
+ * for longer than a frame, the next frame is painted right away. Otherwise
+ * there is nothing to do until the document timer posts new changes.
+ * During a frame this only marks that another one is wanted, timerEvent
+ * starts the timer once the frame is done.
+ */
+void ViewArea::scheduleFrame () {
+    if (m_in_frame) {
+        m_frame_wanted = true;
+        return;
+    }
+    if (m_repaint_timer)
+        return;
+    if (!m_frame_clock.isValid ())
+        m_frame_clock.start ();
+    qint64 now = m_frame_clock.elapsed ();
+    if (m_next_frame < now)
+        m_next_frame = now;
+    m_repaint_timer = startTimer ((int) (m_next_frame - now), Qt::PreciseTimer);
+}
+
 void ViewArea::enableUpdaters (bool enable, unsigned int skip) {
     m_updaters_enabled = enable;
     Connection *connect = m_updaters.first ();
@@ -2240,8 +3193,7 @@ void ViewArea::enableUpdaters (bool enable, unsigned int skip) {
         for (; connect; connect = m_updaters.next ())
             if (connect->connecter)
                 connect->connecter->message (MsgSurfaceUpdate, &event);
-        if (!m_repaint_timer)
-            m_repaint_timer = startTimer (25);
+        scheduleFrame ();
     } else if (!enable && m_repaint_timer &&
             m_repaint_rect.isEmpty () && m_update_rect.isEmpty ()) {
         killTimer (m_repaint_timer);
@@ -2256,24 +3208,60 @@ void ViewArea::timerEvent (QTimerEvent * e) {
         if (m_fullscreen)
             setCursor (QCursor (Qt::BlankCursor));
     } else if (e->timerId () == m_repaint_timer) {
+        killTimer (m_repaint_timer);
+        m_repaint_timer = 0;
+#ifdef KMPLAYER_WITH_XCB_SHM
+        if (d->presentPending ()) {
+            // the server still reads the last frame, start this one when
+            // it reports completion, or check again a refresh later
+            d->frame_deferred = true;
+            m_repaint_timer = startTimer (frameInterval (), Qt::PreciseTimer);
+            return;
+        }
+        d->frame_deferred = false;
+#endif
+        const int interval = frameInterval ();
+        const qint64 start = m_frame_clock.elapsed ();
+        if (start > m_next_frame + interval / 2)
+            m_frame_stats.late_frames++;
+        if (start >= m_next_frame + interval) {
+            // started so late that whole refresh slots passed
+            qint64 missed = (start - m_next_frame) / interval;
+            m_frame_stats.dropped_frames += missed;
+            m_next_frame += missed * interval;
+        }
+        m_next_frame += interval;
+        m_in_frame = true;
+        m_frame_wanted = false;
         Connection *connect = m_updaters.first ();
-        int count = 0;
         if (m_updaters_enabled && connect) {
+            // progress follows the document clock, so a late frame just
+            // jumps ahead; skipped_time is only for postponed documents
             UpdateEvent event (connect->connecter->document (), 0);
-            for (; connect; count++, connect = m_updaters.next ())
+            for (; connect; connect = m_updaters.next ())
                 if (connect->connecter)
                     connect->connecter->message (MsgSurfaceUpdate, &event);
         }
         //repaint (m_repaint_rect, false);
         if (!m_repaint_rect.isEmpty () || !m_update_rect.isEmpty ()) {
             syncVisual ();
-            m_repaint_rect = IRect ();
+            m_repaint_rect.clear ();
         }
-        if (m_update_rect.isEmpty () &&
-                (!m_updaters_enabled || !m_updaters.first ())) {
-            killTimer (m_repaint_timer);
-            m_repaint_timer = 0;
+        m_in_frame = false;
+        const qint64 end = m_frame_clock.elapsed ();
+        m_frame_stats.frames++;
+        m_frame_stats.frame_time += end - start;
+        if (end - start > m_frame_stats.max_frame_time)
+            m_frame_stats.max_frame_time = (int) (end - start);
+        if (m_next_frame <= end) {
+            // overrun, drop the refresh slots that passed while painting
+            qint64 missed = (end - m_next_frame) / interval + 1;
+            m_frame_stats.dropped_frames += missed;
+            m_next_frame += missed * interval;
         }
+        if (m_frame_wanted || !m_update_rect.isEmpty () ||
+                (m_updaters_enabled && m_updaters.first ()))
+            scheduleFrame ();
     } else if (e->timerId () == m_restore_fullscreen_timer) {
         xcb_connection_t* connection = QX11Info::connection();
         xcb_get_window_attributes_cookie_t cookie = xcb_get_window_attributes(connection, winId());
@@ -2350,6 +3338,18 @@ bool ViewArea::nativeEventFilter(const QByteArray& eventType, void * message, lo
         return false;
 
     xcb_generic_event_t* event = (xcb_generic_event_t*)message;
+#ifdef KMPLAYER_WITH_XCB_SHM
+    if (d->shmCompleted (event)) {
+        if (d->frame_deferred) {
+            d->frame_deferred = false;
+            if (m_repaint_timer)
+                killTimer (m_repaint_timer);
+            m_repaint_timer = 0;
+            scheduleFrame ();
+        }
+        return true;
+    }
+#endif
     switch (event->response_type & ~0x80) {
     case XCB_UNMAP_NOTIFY: {
         xcb_unmap_notify_event_t* ev = (xcb_unmap_notify_event_t*)event;
@@ -10,8 +10,10 @@
 
 #include <QWidget>
 #include <QAbstractNativeEventFilter>
+#include <QElapsedTimer>
 typedef QWidget QX11EmbedContainer;
 #include <QList>
+#include <QVector>
 
 #include "mediaobject.h"
 #include "surface.h"
@@ -26,6 +28,26 @@ class IViewer;
 class ViewerAreaPrivate;
 class VideoOutput;
 
+/*
+ * Bounded set of disjoint damage rectangles, rectangles that overlap or
+ * would waste little area are merged
+ */
+class KMPLAYERCOMMON_NO_EXPORT DamageRegion
+{
+public:
+    enum { MaxRects = 8 };
+
+    void add (const IRect &rect);
+    void clear () { rects.clear (); }
+    bool isEmpty () const { return rects.isEmpty (); }
+    DamageRegion intersect (const IRect &rect) const;
+    DamageRegion unite (const DamageRegion &r) const;
+    IRect bounds () const;
+    int area () const;
+
+    QVector <IRect> rects;
+};
+
 /*
  * The area in which the video widget and controlpanel are laid out
  */
@@ -34,6 +56,20 @@ class KMPLAYERCOMMON_EXPORT ViewArea : public QWidget, public QAbstractNativeEve
     friend class VideoOutput;
     Q_OBJECT
 public:
+    /*
+     * Statistics of the frames painted since this view was created
+     */
+    struct FrameStats {
+        FrameStats ()
+            : frames (0), late_frames (0), dropped_frames (0),
+              painted_pixels (0), frame_time (0), max_frame_time (0) {}
+        int frames;
+        int late_frames;         // started more than half a frame late
+        int dropped_frames;      // refresh slots skipped after an overrun
+        qint64 painted_pixels;
+        qint64 frame_time;       // ms spent in updaters and painting
+        int max_frame_time;
+    };
     ViewArea(QWidget* parent, View *view, bool paint_bg);
     ~ViewArea() override;
     KMPLAYERCOMMON_NO_EXPORT bool isFullScreen () const { return m_fullscreen; }
@@ -46,6 +82,8 @@ public:
     ConnectionList* updaters() KMPLAYERCOMMON_NO_EXPORT;
     void resizeEvent(QResizeEvent*) override KMPLAYERCOMMON_NO_EXPORT;
     void enableUpdaters(bool enable, unsigned int off_time) KMPLAYERCOMMON_NO_EXPORT;
+    KMPLAYERCOMMON_NO_EXPORT const FrameStats &frameStats () const { return m_frame_stats; }
+    KMPLAYERCOMMON_NO_EXPORT void surfacesChanged () { m_surface_generation++; }
     void minimalMode ();
     IViewer *createVideoWidget ();
     void destroyVideoWidget (IViewer *widget);
@@ -72,6 +110,8 @@ protected:
     QPaintEngine *paintEngine () const override;
 private:
     void syncVisual() KMPLAYERCOMMON_NO_EXPORT;
+    void scheduleFrame() KMPLAYERCOMMON_NO_EXPORT;
+    int frameInterval() const KMPLAYERCOMMON_NO_EXPORT;
     void updateSurfaceBounds() KMPLAYERCOMMON_NO_EXPORT;
     void stopTimers() KMPLAYERCOMMON_NO_EXPORT;
 
@@ -80,18 +120,24 @@ private:
     View * m_view;
     KActionCollection * m_collection;
     SurfacePtr surface;
-    IRect m_repaint_rect;
-    IRect m_update_rect;
+    DamageRegion m_repaint_rect;
+    DamageRegion m_update_rect;
     QRect m_topwindow_rect;
     typedef QList <IViewer *> VideoWidgetList;
     VideoWidgetList video_widgets;
     int m_mouse_invisible_timer;
     int m_repaint_timer;
     int m_restore_fullscreen_timer;
+    QElapsedTimer m_frame_clock;
+    qint64 m_next_frame;
+    FrameStats m_frame_stats;
+    unsigned int m_surface_generation; // bumped by Surface::boundsChanged
     bool m_fullscreen;
     bool m_minimal;
     bool m_updaters_enabled;
     bool m_paint_background;
+    bool m_in_frame;         // updaters and painting of a frame are running
+    bool m_frame_wanted;     // scheduleFrame was called while m_in_frame
 };
 
 /*